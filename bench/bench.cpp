@@ -0,0 +1,292 @@
+// Throughput benchmark of every engine over synthetic corpora and a fixed pattern matrix.
+//
+// Usage: build/bench [--size=MB] [--budget=SECONDS] [--filter=TEXT]
+//
+// Prints one JSON object per (corpus, pattern, engine) case on stdout. Every case runs in its own
+// forked process, so the peak RSS and the per-thread caches belong to that case alone. Fast cases
+// repeat the corpus until they have run for a quarter of a second; slow ones stop once they have
+// used their time budget, and "truncated" tells whether they got through the whole corpus.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Matcher.hpp"
+#include "search.hpp"
+
+
+namespace {
+    struct Corpus {
+        std::string name;
+        std::string text;
+        size_t lines = 0;
+    };
+
+    struct BenchPattern {
+        std::string name;
+        std::string pattern;
+        bool prefilter = true; // off where the prefilter would reject every line before the engine runs
+    };
+
+    // Engines compared, by name; "match_pattern" compiles the pattern for every line, as
+    // Matcher::match_pattern callers do, and "batch" matches the lines of each slice with match_lines
+    const std::vector<std::pair<std::string, Engine>> ENGINES = {
+            {"auto",          Engine::Auto},
+            {"dfa",           Engine::DFA},
+            {"pike",          Engine::PikeVM},
+            {"backtrack",     Engine::Backtrack},
+            {"tree",          Engine::Tree},
+            {"match_pattern", Engine::Auto},
+            {"batch",         Engine::Auto},
+    };
+
+    const std::vector<BenchPattern> PATTERNS = {
+            {"literal",        "timeout"},
+            {"rare_literal",   "XYZZY"},
+            {"class",          "[xyz]\\d\\d"},
+            {"negated_class",  "^[^q]+$"},
+            {"digits",         "\\d\\d\\d\\d\\d"},
+            {"word_chain",     "\\w+ \\w+ \\w+ failed"},
+            {"alternation",    "(error|warning|failed) \\d+"},
+            {"anchored",       "^2024-01-1\\d info"},
+            {"backreference",  "(\\w+) \\1"},
+            {"nested_plus",    "(a+)+b", false},
+            {"overlapping",    "(a|a)+(a|a)+b", false},
+            {"word_repeat",    "(\\w+\\w+)+\\d$", false},
+    };
+
+    // Deterministic generator: the standard distributions differ between libraries, raw draws don't.
+    class Generator {
+    private:
+        std::mt19937_64 engine;
+
+    public:
+        explicit Generator(const uint64_t seed) : engine(seed) {}
+
+        size_t below(const size_t bound) {
+            return engine() % bound;
+        }
+
+        template <typename Item>
+        const Item &pick(const std::vector<Item> &items) {
+            return items[below(items.size())];
+        }
+    };
+
+    Corpus make_corpus(const std::string &name, const size_t size, const std::function<void(Generator &, std::string &)> &line) {
+        Corpus corpus{name, {}};
+        Generator generator(42);
+
+        corpus.text.reserve(size + 128 * 1024);
+        while (corpus.text.size() < size) {
+            line(generator, corpus.text);
+            corpus.text += '\n';
+            corpus.lines++;
+        }
+        return corpus;
+    }
+
+    std::vector<Corpus> make_corpora(const size_t size) {
+        const std::vector<std::string> words = {"error", "warning", "info", "debug", "user", "login", "failed",
+                                                "request", "timeout", "cache", "disk", "memory", "connection"};
+
+        return {
+                make_corpus("log", size, [&](Generator &generator, std::string &text) {
+                    text += "2024-01-" + std::to_string(10 + generator.below(20)) + " ";
+                    for (int word = 0; word < 8; word++) {
+                        text += generator.pick(words);
+                        text += ' ';
+                    }
+                    text += std::to_string(generator.below(100000));
+                }),
+                make_corpus("random", size, [](Generator &generator, std::string &text) {
+                    const size_t length = 40 + generator.below(80);
+                    for (size_t index = 0; index < length; index++) {
+                        text += static_cast<char>(' ' + generator.below(95));
+                    }
+                }),
+                make_corpus("long_lines", size, [&](Generator &generator, std::string &text) {
+                    for (size_t length = 0; length < 64 * 1024; length += 8) {
+                        text += generator.pick(words).substr(0, 7);
+                        text += ' ';
+                    }
+                }),
+                make_corpus("short_lines", size, [](Generator &generator, std::string &text) {
+                    const size_t length = 1 + generator.below(8);
+                    for (size_t index = 0; index < length; index++) {
+                        text += static_cast<char>('a' + generator.below(26));
+                    }
+                }),
+                // Runs of 'a' without a 'b', on which nested repetitions backtrack exponentially
+                make_corpus("pathological", size / 16, [](Generator &generator, std::string &text) {
+                    text.append(16 + generator.below(48), 'a');
+                }),
+        };
+    }
+
+    std::string json_escape(const std::string_view text) {
+        std::string escaped;
+        for (const char byte: text) {
+            if (byte == '"' or byte == '\\') {
+                escaped += '\\';
+            }
+            escaped += byte;
+        }
+        return escaped;
+    }
+
+    constexpr double MIN_SECONDS = 0.25;
+
+    // Searches the corpus in slices of about 64 KiB, checking the budget between slices
+    void run_case(const Corpus &corpus, const BenchPattern &bench_pattern, const std::string &engine_name,
+                  const Engine engine, const double budget) {
+        PatternConfig config;
+        config.engine = engine;
+        config.prefilter = bench_pattern.prefilter;
+        const CompiledPattern pattern = Matcher::compile(bench_pattern.pattern, config);
+        const bool per_line_compile = engine_name == "match_pattern";
+        const bool batch = engine_name == "batch";
+        std::vector<std::string_view> batch_lines;
+        std::vector<uint64_t> batch_matches;
+
+        constexpr size_t SLICE_SIZE = 64 * 1024;
+        size_t bytes = 0;
+        size_t lines = 0;
+        size_t matches = 0; // in the first pass
+        size_t passes = 0;
+        bool truncated = false;
+
+        const auto start = std::chrono::steady_clock::now();
+        auto elapsed = [&] {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        std::string_view rest = corpus.text;
+        while (not truncated) {
+            if (rest.empty()) {
+                passes++;
+                if (elapsed() >= MIN_SECONDS) {
+                    break;
+                }
+                rest = corpus.text;
+            }
+            if (elapsed() > budget) {
+                truncated = passes == 0;
+                break;
+            }
+
+            size_t end = std::min(SLICE_SIZE, rest.size());
+            const size_t newline = rest.find('\n', end);
+            end = newline == std::string_view::npos ? rest.size() : newline + 1;
+            const std::string_view slice = rest.substr(0, end);
+
+            size_t slice_matches = 0;
+            if (per_line_compile) {
+                for_each_line(slice, [&](std::string_view line) {
+                    slice_matches += Matcher::match_pattern(line, bench_pattern.pattern);
+                    return true;
+                });
+            } else if (batch) {
+                batch_lines.clear();
+                for_each_line(slice, [&](std::string_view line) {
+                    batch_lines.push_back(line);
+                    return true;
+                });
+                batch_matches.resize(bitmap_words(batch_lines.size()));
+                slice_matches += pattern.match_lines(batch_lines, batch_matches);
+            } else {
+                for_each_matching_line(pattern, slice, [&](std::string_view) {
+                    slice_matches++;
+                    return true;
+                });
+            }
+            if (passes == 0) {
+                matches += slice_matches;
+            }
+
+            bytes += slice.size();
+            lines += count_newlines(slice);
+            rest.remove_prefix(end);
+        }
+
+        const double seconds = elapsed();
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+
+        std::printf("{\"corpus\":\"%s\",\"pattern_name\":\"%s\",\"pattern\":\"%s\",\"engine\":\"%s\","
+                    "\"passes\":%zu,\"bytes\":%zu,\"lines\":%zu,\"matches\":%zu,\"seconds\":%.6f,\"mb_per_s\":%.2f,"
+                    "\"ns_per_line\":%.1f,\"peak_rss_kb\":%ld,\"truncated\":%s}\n",
+                    corpus.name.c_str(), bench_pattern.name.c_str(), json_escape(bench_pattern.pattern).c_str(),
+                    engine_name.c_str(), passes, bytes, lines, matches, seconds, bytes / seconds / 1e6,
+                    lines > 0 ? seconds * 1e9 / static_cast<double>(lines) : 0.0, usage.ru_maxrss,
+                    truncated ? "true" : "false");
+        std::fflush(stdout);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    size_t size = 8 << 20;
+    double budget = 2.0;
+    std::string filter;
+
+    for (int index = 1; index < argc; index++) {
+        const std::string_view argument = argv[index];
+        if (argument.starts_with("--size=")) {
+            size = std::strtoull(argv[index] + 7, nullptr, 10) << 20;
+        } else if (argument.starts_with("--budget=")) {
+            budget = std::strtod(argv[index] + 9, nullptr);
+        } else if (argument.starts_with("--filter=")) {
+            filter = argument.substr(9);
+        } else {
+            std::fprintf(stderr, "Usage: %s [--size=MB] [--budget=SECONDS] [--filter=TEXT]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const std::vector<Corpus> corpora = make_corpora(size);
+
+    for (const auto &corpus: corpora) {
+        for (const auto &bench_pattern: PATTERNS) {
+            // Patterns with backreferences always backtrack, so only the two backtracking engines differ.
+            const bool has_backrefs = Matcher::compile(bench_pattern.pattern).selected_engine() == Engine::Backtrack;
+
+            for (const auto &[engine_name, engine]: ENGINES) {
+                if (has_backrefs and (engine == Engine::DFA or engine == Engine::PikeVM)) {
+                    continue;
+                }
+                const std::string name = corpus.name + "/" + bench_pattern.name + "/" + engine_name;
+                if (not filter.empty() and name.find(filter) == std::string::npos) {
+                    continue;
+                }
+
+                const pid_t child = fork();
+                if (child == 0) {
+                    run_case(corpus, bench_pattern, engine_name, engine, budget);
+                    std::_Exit(0);
+                }
+                if (child < 0) {
+                    std::perror("fork");
+                    return 2;
+                }
+
+                int status = 0;
+                waitpid(child, &status, 0);
+                if (not WIFEXITED(status) or WEXITSTATUS(status) != 0) {
+                    std::fprintf(stderr, "%s: benchmark process failed\n", name.c_str());
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,59 @@
+#!/bin/bash
+# Measures how recursive search scales with the thread count on a warm synthetic tree.
+#
+# Usage: bench/recursive.sh [directories] [files per directory] [lines per file]
+# Run from the repository root after `make`.
+
+set -e
+
+DIRECTORIES="${1:-200}"
+FILES="${2:-50}"
+LINES="${3:-200}"
+PATTERN='failed \w+ 4\d\d'
+TREE="$(mktemp -d)"
+trap 'rm -rf "$TREE"' EXIT
+
+# Log-like lines built from a small vocabulary, spread over two directory levels
+for ((directory = 0; directory < DIRECTORIES; directory++)); do
+    mkdir -p "$TREE/d$((directory % 10))/d$directory"
+    awk -v files="$FILES" -v lines="$LINES" -v seed="$directory" -v dir="$TREE/d$((directory % 10))/d$directory" '
+        BEGIN {
+            srand(seed)
+            split("error warn info debug user login failed request timeout cache disk", words, " ")
+            for (file = 0; file < files; file++) {
+                path = dir "/f" file ".log"
+                for (line = 0; line < lines; line++) {
+                    text = ""
+                    for (word = 0; word < 8; word++) {
+                        text = text words[int(rand() * 11) + 1] " "
+                    }
+                    print text int(rand() * 100000) > path
+                }
+                close(path)
+            }
+        }'
+done
+
+echo "tree: $(find "$TREE" -type f | wc -l) files, $(du -sh "$TREE" | cut -f1)"
+
+# Warm the page cache, then time each thread count
+./server -r -E "$PATTERN" "$TREE" > /dev/null || true
+
+measure() {
+    local start end
+    start=$(date +%s%N)
+    ./server -r -j "$1" -E "$PATTERN" "$TREE" > /dev/null || true
+    end=$(date +%s%N)
+    echo $(((end - start) / 1000000))
+}
+
+baseline=$(measure 1)
+printf "%8s %10s %8s\n" threads ms speedup
+printf "%8d %10d %8s\n" 1 "$baseline" "1.00"
+
+threads=2
+while ((threads <= $(nproc))); do
+    elapsed=$(measure "$threads")
+    printf "%8d %10d %8s\n" "$threads" "$elapsed" "$(awk -v b="$baseline" -v e="$elapsed" 'BEGIN { printf "%.2f", b / e }')"
+    threads=$((threads * 2))
+done
@@ -0,0 +1,49 @@
+#ifndef AHO_CORASICK_HPP
+#define AHO_CORASICK_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Automaton finding every occurrence of a set of keys in one pass, whatever their number. It is
+// built as a DFA: each state has a transition for every byte class (the bytes that appear in some
+// key each get a class, all other bytes share one), so scanning costs one lookup per byte.
+class AhoCorasick {
+private:
+    std::array<uint8_t, 256> byte_classes{};
+    size_t class_count = 1;
+    std::vector<uint32_t> transitions;  // class_count entries per state
+    std::vector<int32_t> keys;          // key ending at the state, or -1
+    std::vector<int32_t> output_links;  // nearest proper suffix state where a key ends, or -1
+
+public:
+    static constexpr uint32_t START = 0;
+
+    AhoCorasick() = default;
+
+    // Keys must be distinct and not empty; the id of a key is its index
+    explicit AhoCorasick(const std::vector<std::string> &keys);
+
+    [[nodiscard]] uint32_t next(const uint32_t state, const unsigned char byte) const {
+        return transitions[state * class_count + byte_classes[byte]];
+    }
+
+    // Whether some key ends at the last byte consumed
+    [[nodiscard]] bool has_output(const uint32_t state) const {
+        return keys[state] >= 0 or output_links[state] >= 0;
+    }
+
+    // Calls on_key with the id of every key ending at the last byte consumed
+    template <typename OnKey>
+    void for_each_key(const uint32_t state, OnKey &&on_key) const {
+        int32_t current = keys[state] >= 0 ? static_cast<int32_t>(state) : output_links[state];
+        while (current >= 0) {
+            on_key(keys[current]);
+            current = output_links[current];
+        }
+    }
+};
+
+#endif //AHO_CORASICK_HPP
@@ -0,0 +1,38 @@
+#ifndef BACKTRACKER_HPP
+#define BACKTRACKER_HPP
+
+#include <string_view>
+#include <vector>
+
+#include "program.hpp"
+
+
+// Depth-first interpreter of a program with an explicit stack, the only engine that handles
+// backreferences and atomic groups. Without backreferences every (pc, position) pair outside the
+// atomic groups is explored at most once per line. Leaving an atomic group drops the alternatives
+// saved inside it. A search gives up after step_budget instructions, or once its stack outgrows
+// memory_limit bytes; the table of failed pairs is only kept if it fits in that limit too.
+class Backtracker {
+private:
+    const Program &program;
+    bool memoize;
+    size_t step_budget;
+    size_t memory_limit;
+
+public:
+    enum class Result {
+        NoMatch,
+        Match,
+        GaveUp, // the input exceeded the step budget or the memory limit
+    };
+
+    Backtracker(const Program &program, const bool memoize, const size_t step_budget, const size_t memory_limit)
+            : program(program), memoize(memoize), step_budget(step_budget), memory_limit(memory_limit) {}
+
+    // Leftmost-first search for the program in the input, starting at from or after it. When captures
+    // is not null it receives Program::slot_count() positions, std::string_view::npos for groups that
+    // did not take part.
+    [[nodiscard]] Result search(std::string_view input, std::vector<size_t> *captures, size_t from = 0) const;
+};
+
+#endif //BACKTRACKER_HPP
@@ -0,0 +1,65 @@
+#ifndef BYTE_CLASS_HPP
+#define BYTE_CLASS_HPP
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+
+// Set of bytes matched by a character class, \d, \w or the wildcard, as a 256-bit bitmap. It also keeps
+// the bitmap split by nibbles so that runs of bytes can be classified 16 or 32 at a time with SSE4.2 or
+// AVX2, whichever the CPU supports; the scalar path costs one load and test per byte.
+class ByteClass {
+private:
+    std::array<uint64_t, 4> words{};
+    // Bit (high nibble & 7) of entry [low nibble] is set when the byte is in the class, for bytes
+    // below 0x80 in low_rows and the others in high_rows.
+    alignas(16) std::array<uint8_t, 16> low_rows{};
+    alignas(16) std::array<uint8_t, 16> high_rows{};
+
+public:
+    void insert(unsigned char byte);
+
+    void insert_range(unsigned char first, unsigned char last);
+
+    // Replace the class by its complement
+    void invert();
+
+    [[nodiscard]] bool contains(const unsigned char byte) const {
+        return (words[byte >> 6] >> (byte & 63)) & 1;
+    }
+
+    [[nodiscard]] bool operator[](const unsigned char byte) const {
+        return contains(byte);
+    }
+
+    [[nodiscard]] int count() const;
+
+    // Whether a byte is in both classes
+    [[nodiscard]] bool intersects(const ByteClass &other) const {
+        for (size_t word = 0; word < words.size(); word++) {
+            if ((words[word] & other.words[word]) != 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    [[nodiscard]] bool all() const {
+        return count() == 256;
+    }
+
+    // First position at or after from whose byte is in the class if inside is false, or out of it if
+    // inside is true; input.size() if there is none. span(input, from, true) skips a run of members.
+    [[nodiscard]] size_t span(std::string_view input, size_t from, bool inside) const;
+
+    [[nodiscard]] const uint8_t *low_table() const {
+        return low_rows.data();
+    }
+
+    [[nodiscard]] const uint8_t *high_table() const {
+        return high_rows.data();
+    }
+};
+
+#endif //BYTE_CLASS_HPP
@@ -0,0 +1,126 @@
+#ifndef COMPILED_PATTERN_HPP
+#define COMPILED_PATTERN_HPP
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "LazyDFA.hpp"
+#include "literals.hpp"
+#include "program.hpp"
+#include "tokens.hpp"
+#include "trigrams.hpp"
+
+
+// Matching engine used for a pattern
+enum class Engine {
+    Auto,      // lazy DFA unless the pattern has backreferences or atomic groups
+    Tree,      // recursive walk of the token tree
+    Backtrack, // backtracking interpreter of the compiled program
+    PikeVM,    // linear-time NFA simulation
+    DFA,       // lazily built DFA, falling back to the Pike VM when its cache thrashes
+};
+
+// Tunables of a compiled pattern
+struct PatternConfig {
+    static constexpr size_t DEFAULT_STEP_BUDGET = 10'000'000;
+    static constexpr size_t DEFAULT_MATCH_MEMORY_LIMIT = 64 << 20;
+
+    Engine engine = Engine::Auto;
+    size_t dfa_memory_limit = LazyDFA::DEFAULT_MEMORY_LIMIT; // per thread
+    bool prefilter = true; // reject inputs lacking a required literal before running the engine
+    bool memoize = true;   // remember failed positions when backtracking without backreferences
+
+    // Work allowed to the backtracking engines on one line, 0 for no limit. Lines exceeding either
+    // limit are matched by the Pike VM instead, or given up on if the pattern has backreferences or
+    // atomic groups.
+    size_t step_budget = DEFAULT_STEP_BUDGET;                // instructions or tree walk steps
+    size_t match_memory_limit = DEFAULT_MATCH_MEMORY_LIMIT; // bytes of backtracking stack, captures or memo
+
+    // Called, from whichever thread is matching, with each line given up on; such lines don't match
+    std::function<void(std::string_view line)> on_budget_exceeded;
+};
+
+// Words of a bitmap holding one bit per line, as filled by match_lines()
+constexpr size_t bitmap_words(const size_t lines) {
+    return (lines + 63) / 64;
+}
+
+// Pattern tokenized once and matched against any number of lines. It is immutable after
+// construction, so a single instance can be shared between threads; the engines keep their scratch
+// space (captures, stacks, DFA states) per thread.
+class CompiledPattern {
+private:
+    std::shared_ptr<const Token> root;
+    Program program;
+    PatternConfig config;
+    uint64_t dfa_cache_id;
+    std::vector<LiteralSearcher> required_literals; // rarest first
+    bool literal_only = false; // the pattern is a single literal, matching wherever it occurs
+    int memo_slot_count = 0;
+
+    // Whether the tree walk matches the input, or nullopt if it ran out of budget
+    [[nodiscard]] std::optional<bool> walk_tree(std::string_view input) const;
+
+    // Matches an input on which a backtracking engine gave up
+    [[nodiscard]] bool match_over_budget(std::string_view input) const;
+
+    // Reports an input that can't be matched within the budget
+    void give_up(std::string_view input) const;
+
+    // match(), checking only the required literals from first_literal on
+    [[nodiscard]] bool match_from_literal(std::string_view input, size_t first_literal,
+                                          std::optional<LazyDFA> &dfa) const;
+
+public:
+    explicit CompiledPattern(const std::string &pattern, const PatternConfig &config = {});
+
+    // Engine actually used; patterns with backreferences or atomic groups always backtrack (or walk the tree)
+    [[nodiscard]] Engine selected_engine() const {
+        return config.engine;
+    }
+
+    // Searcher for the rarest literal every match contains, or nullptr if there is none. Inputs
+    // without it can be skipped without calling match().
+    [[nodiscard]] const LiteralSearcher *prefilter() const {
+        return required_literals.empty() ? nullptr : &required_literals.front();
+    }
+
+    // Whether the pattern is the literal returned by prefilter(), so finding it is a match
+    [[nodiscard]] bool is_literal() const {
+        return literal_only;
+    }
+
+    // Checks whether the pattern matches anywhere in the input
+    [[nodiscard]] bool match(std::string_view input) const;
+
+    // match(), with the DFA of the pattern created on first use and kept in dfa for the next input.
+    // dfa must only be used by the calling thread.
+    [[nodiscard]] bool match(std::string_view input, std::optional<LazyDFA> &dfa) const;
+
+    // match(), for an input known to hold the literal of prefilter(), which isn't searched for again
+    [[nodiscard]] bool match_prefiltered(std::string_view input, std::optional<LazyDFA> &dfa) const;
+
+    // Matches a batch of lines, setting bit i % 64 of matches[i / 64] if lines[i] matches and
+    // clearing it otherwise. matches must hold bitmap_words(lines.size()) words, or
+    // std::invalid_argument is thrown. Returns the number of matching lines. The engine is set up
+    // once per batch rather than once per line.
+    size_t match_lines(std::span<const std::string_view> lines, std::span<uint64_t> matches) const;
+
+    // Span of the leftmost-first match starting at from or after it, or nullopt if there is none.
+    // The lazy DFA can't locate matches, so this runs the Pike VM, or the backtracker for patterns
+    // that need it.
+    [[nodiscard]] std::optional<Span> find(std::string_view input, size_t from = 0) const;
+
+    // Trigrams every matching line contains, for searching a trigram index
+    [[nodiscard]] TrigramQuery trigram_query() const;
+
+    // Dump of the token tree and the compiled program, for debugging
+    [[nodiscard]] std::string to_string() const;
+};
+
+#endif //COMPILED_PATTERN_HPP
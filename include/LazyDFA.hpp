@@ -0,0 +1,49 @@
+#ifndef LAZY_DFA_HPP
+#define LAZY_DFA_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+#include "program.hpp"
+
+
+// Deterministic automaton built from a program one state at a time, while scanning. States live in
+// a per-thread cache bounded by memory_limit; a full cache is flushed and rebuilt on demand. The caches
+// of one thread are evicted least recently used first once together they use more memory than a few
+// full ones would, so a thread can keep the warm states of many small DFAs. The DFA only answers
+// whether the input matches: it tracks no capture positions.
+class LazyDFA {
+private:
+    struct Cache;
+
+    const Program &program;
+    std::shared_ptr<Cache> cache;
+    size_t memory_limit;
+
+    // The cache of the program on this thread, created on first use
+    static std::shared_ptr<Cache> cache_for(const Program &program, uint64_t id, size_t memory_limit);
+
+public:
+    enum class Result {
+        NoMatch,
+        Match,
+        GaveUp, // the cache kept thrashing, the caller should use another engine
+    };
+
+    static constexpr size_t DEFAULT_MEMORY_LIMIT = 2 << 20;
+
+    // Every distinct program needs its own cache_id; copies of the same program may share one. The
+    // cache is looked up once, so searching many inputs with one LazyDFA is cheaper than constructing
+    // one per input. A LazyDFA is only used by the thread that created it. It keeps its cache alive
+    // even once evicted, but then the next LazyDFA of the program starts from an empty one.
+    LazyDFA(const Program &program, const uint64_t cache_id, const size_t memory_limit)
+            : program(program), cache(cache_for(program, cache_id, memory_limit)), memory_limit(memory_limit) {}
+
+    // Returns an identifier not used by any other program
+    static uint64_t new_cache_id();
+
+    [[nodiscard]] Result search(std::string_view input) const;
+};
+
+#endif //LAZY_DFA_HPP
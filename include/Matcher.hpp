@@ -1,15 +1,24 @@
 #ifndef MATCHER_HPP
 #define MATCHER_HPP
 
-#include <ranges>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "CompiledPattern.hpp"
+#include "PatternSet.hpp"
 
-#include "tokenizer.hpp"
-#include "utils.hpp"
 
 class Matcher {
 public:
-    static bool match_pattern(const std::string &input, const std::string &pattern);
+    // Compiles a pattern for repeated matching
+    static CompiledPattern compile(const std::string &pattern, const PatternConfig &config = {});
+
+    // Compiles patterns searched together
+    static PatternSet compile_set(const std::vector<std::string> &patterns, const PatternConfig &config = {});
+
+    // One-off match; prefer compile() when the same pattern is used for many inputs
+    static bool match_pattern(std::string_view input, const std::string &pattern);
 };
 
 
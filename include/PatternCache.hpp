@@ -0,0 +1,37 @@
+#ifndef PATTERN_CACHE_HPP
+#define PATTERN_CACHE_HPP
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "CompiledPattern.hpp"
+#include "PatternSet.hpp"
+
+
+// Compiled patterns keyed by their text, the least recently used being evicted beyond capacity. A
+// text holds one pattern per line, like a file given to -f. Safe to share between threads; patterns
+// are compiled outside the lock, and stay alive while a caller holds them even once evicted.
+class PatternCache {
+private:
+    using Entry = std::pair<std::string, std::shared_ptr<const PatternSet>>;
+
+    PatternConfig config;
+    size_t capacity;
+    std::mutex mutex;
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index; // keys point into entries
+
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 256;
+
+    PatternCache(PatternConfig config, size_t capacity);
+
+    // Returns the patterns of the text, compiling them on a miss. Throws PatternError for a malformed one.
+    [[nodiscard]] std::shared_ptr<const PatternSet> get(const std::string &text);
+};
+
+#endif //PATTERN_CACHE_HPP
@@ -0,0 +1,68 @@
+#ifndef PATTERN_SET_HPP
+#define PATTERN_SET_HPP
+
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AhoCorasick.hpp"
+#include "CompiledPattern.hpp"
+
+
+// Patterns searched together: a line matches if any of them does. The rarest required literal of
+// every pattern goes into one Aho-Corasick automaton, scanned once over the input, and a pattern is
+// only run on the lines where its literal was found. Plain literals are matched by the automaton
+// alone. Like CompiledPattern it is immutable after construction and can be shared between threads.
+class PatternSet {
+private:
+    std::vector<CompiledPattern> patterns;
+    AhoCorasick automaton;
+    std::vector<std::vector<size_t>> patterns_by_key; // patterns whose literal is the key
+    std::vector<size_t> unkeyed;                      // patterns without a literal, run on every line
+
+    // DFAs of the patterns, indexed like them and created on first use, kept across the lines of a call
+    using Dfas = std::vector<std::optional<LazyDFA>>;
+
+    // Whether a pattern keyed by a literal found on the line, or an unkeyed one, matches it
+    [[nodiscard]] bool match_candidates(std::string_view line, std::vector<int32_t> &found_keys, Dfas &dfas) const;
+
+    // match(), with the DFAs of the patterns kept in dfas for the next input
+    [[nodiscard]] bool match(std::string_view input, Dfas &dfas) const;
+
+public:
+    // A pattern holding newlines stands for one pattern per line. Throws PatternError for the first
+    // malformed pattern.
+    PatternSet(const std::vector<std::string> &patterns, const PatternConfig &config = {});
+
+    [[nodiscard]] size_t size() const {
+        return patterns.size();
+    }
+
+    [[nodiscard]] const CompiledPattern &front() const {
+        return patterns.front();
+    }
+
+    // Checks whether any pattern matches anywhere in the input
+    [[nodiscard]] bool match(std::string_view input) const;
+
+    // Matches a batch of lines into a bitmap, like CompiledPattern::match_lines
+    size_t match_lines(std::span<const std::string_view> lines, std::span<uint64_t> matches) const;
+
+    // Span of the first match of any pattern starting at from or after it, the longest if several
+    // patterns match there, or nullopt if there is none
+    [[nodiscard]] std::optional<Span> find(std::string_view input, size_t from = 0) const;
+
+    // Start and length of the first line of the block at or after from that some pattern matches, or
+    // std::string_view::npos as the start if there is none. from must be at the start of a line.
+    [[nodiscard]] std::pair<size_t, size_t> find_line(std::string_view block, size_t from) const;
+
+    // Trigrams every line matched by some pattern contains
+    [[nodiscard]] TrigramQuery trigram_query() const;
+
+    // Dump of every pattern, for debugging
+    [[nodiscard]] std::string to_string() const;
+};
+
+#endif //PATTERN_SET_HPP
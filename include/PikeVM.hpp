@@ -0,0 +1,25 @@
+#ifndef PIKE_VM_HPP
+#define PIKE_VM_HPP
+
+#include <string_view>
+#include <vector>
+
+#include "program.hpp"
+
+
+// Runs every NFA thread of a program in lockstep over the input, so a search takes
+// O(instructions x input) time no matter how the pattern nests. Backreferences are not supported.
+class PikeVM {
+private:
+    const Program &program;
+
+public:
+    explicit PikeVM(const Program &program) : program(program) {}
+
+    // Leftmost-first search for the program in the input, starting at from or after it. When captures
+    // is not null it receives Program::slot_count() positions, std::string_view::npos for groups that
+    // did not take part.
+    bool search(std::string_view input, std::vector<size_t> *captures, size_t from = 0) const;
+};
+
+#endif //PIKE_VM_HPP
@@ -0,0 +1,763 @@
+#ifndef STATIC_PATTERN_HPP
+#define STATIC_PATTERN_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "utils.hpp"
+
+
+// Patterns known when the program is built, parsed by the compiler instead of at run time:
+//
+//     using ErrorCode = StaticPattern<"error (\\d+)">;
+//     if (ErrorCode::match(line)) ...
+//
+// The grammar is the one tokenize() accepts, and a malformed pattern fails to compile, naming the
+// problem. The matcher is generated from the parsed tree: character classes become constant bitmaps,
+// runs of literals one comparison each, and sequences straight-line code calling their continuations,
+// with no virtual call or allocation per line. It backtracks like the tree walk, preferring the same
+// alternatives as every other engine, so match() and find() agree with CompiledPattern's. Unlike the
+// runtime engines it keeps no memo nor budget: keep nested ambiguous repetitions such as (a|a)+ out of
+// static patterns.
+namespace static_pattern {
+
+// Pattern text usable as a template argument
+template <size_t Size>
+struct PatternText {
+    char bytes[Size]{};
+
+    consteval PatternText(const char (&text)[Size]) { // NOLINT(google-explicit-constructor)
+        std::copy_n(text, Size, bytes);
+    }
+
+    [[nodiscard]] constexpr std::string_view view() const {
+        return {bytes, Size - 1};
+    }
+};
+
+enum class Kind : uint8_t {
+    Sequence,    // children in order; the Level of the tree walk
+    Alternation, // first child that leads to a match
+    Repeat,      // between min and max repetitions of the child, max -1 for no limit
+    Atomic,      // the first way the child matches only
+    Literal,
+    Class,       // one byte out of `bytes`: classes, \d, \w and the wildcard
+    Begin,
+    End,
+    Backref,
+};
+
+struct Node {
+    Kind kind = Kind::Sequence;
+    char literal = 0;
+    int group = -1;      // capture group of a Sequence or an Alternation, group referenced by a Backref
+    int min = 0;         // bounds of a Repeat
+    int max = -1;
+    int first_child = 0; // children are Tree::children[first_child, first_child + child_count)
+    int child_count = 0;
+    std::array<uint64_t, 4> bytes{};
+
+    [[nodiscard]] constexpr bool contains(const unsigned char byte) const {
+        return (bytes[byte >> 6] >> (byte & 63)) & 1;
+    }
+
+    constexpr void insert_range(const unsigned char first, const unsigned char last) {
+        for (int byte = first; byte <= last; byte++) {
+            bytes[byte >> 6] |= uint64_t{1} << (byte & 63);
+        }
+    }
+
+    // A node always consuming exactly one byte
+    [[nodiscard]] constexpr bool is_byte() const {
+        return kind == Kind::Literal or kind == Kind::Class;
+    }
+
+    // Bytes consumed by a node for which is_byte() holds
+    [[nodiscard]] constexpr std::array<uint64_t, 4> byte_set() const {
+        if (kind == Kind::Class) {
+            return bytes;
+        }
+        std::array<uint64_t, 4> set{};
+        set[static_cast<unsigned char>(literal) >> 6] |= uint64_t{1} << (static_cast<unsigned char>(literal) & 63);
+        return set;
+    }
+};
+
+// Reached on a syntax error during constant evaluation, which makes it fail with the message in the
+// diagnostic. Never defined: it is never called at run time.
+void invalid_pattern(const char *message, size_t offset);
+
+// Parsed pattern of NodeCount nodes, the root first
+template <size_t NodeCount>
+struct Tree {
+    std::array<Node, NodeCount> nodes{};
+    std::array<int, NodeCount> children{}; // every node but the root is the child of one
+    int group_count = 1;
+    bool has_backrefs = false;
+};
+
+// Recursive-descent parser of tokenize()'s grammar, building nodes numbered like its tokens: groups
+// in the order of their '(', the whole pattern being group 0.
+class Parser {
+private:
+    static constexpr int MAX_GROUP = 1 << 20;
+    static constexpr int MAX_COUNT = 1000; // Repeat::MAX_COUNT
+
+    std::string_view pattern;
+    size_t offset = 0;
+    std::vector<std::pair<int, size_t>> backrefs;
+
+    [[nodiscard]] constexpr bool at_end() const {
+        return offset == pattern.size();
+    }
+
+    [[nodiscard]] constexpr char peek() const {
+        return pattern[offset];
+    }
+
+    constexpr int add(const Node &node) {
+        nodes.push_back(node);
+        child_lists.emplace_back();
+        return static_cast<int>(nodes.size()) - 1;
+    }
+
+    constexpr std::vector<int> parse_branches() {
+        std::vector<int> branches{parse_sequence()};
+        while (not at_end() and peek() == '|') {
+            offset++;
+            branches.push_back(parse_sequence());
+        }
+        return branches;
+    }
+
+    constexpr int wrap(const Kind kind, const int child) {
+        Node wrapper;
+        wrapper.kind = kind;
+        const int node = add(wrapper);
+        child_lists[node].push_back(child);
+        return node;
+    }
+
+    constexpr int parse_sequence() {
+        const int sequence = add({});
+        while (not at_end() and peek() != '|' and peek() != ')') {
+            if (const size_t start = offset; parse_quantifier()) {
+                invalid_pattern("nothing to repeat", start);
+            }
+
+            int atom = parse_atom();
+            for (int min = 0, max = 0; not at_end() and parse_quantifier(&min, &max);) {
+                atom = wrap(Kind::Repeat, atom);
+                nodes[atom].min = min;
+                nodes[atom].max = max;
+                if (not at_end() and peek() == '+') {
+                    atom = wrap(Kind::Atomic, atom);
+                    offset++;
+                }
+            }
+            child_lists[sequence].push_back(atom);
+        }
+
+        // Repeated bytes that the next node can't start with are never given back, as in tokenize().
+        for (size_t index = 0; index + 1 < child_lists[sequence].size(); index++) {
+            const int repeat = child_lists[sequence][index];
+            if (nodes[repeat].kind == Kind::Repeat and nodes[child_lists[repeat][0]].is_byte()
+                and starts_outside(child_lists[sequence][index + 1], nodes[child_lists[repeat][0]].byte_set())) {
+                const int atomic = wrap(Kind::Atomic, repeat);
+                child_lists[sequence][index] = atomic;
+            }
+        }
+        return sequence;
+    }
+
+    // Whether a match of the node can neither start with one of the bytes nor be empty before the end of input
+    [[nodiscard]] constexpr bool starts_outside(const int number, const std::array<uint64_t, 4> &set) const {
+        const Node &current = nodes[number];
+        if (current.kind == Kind::End) {
+            return true;
+        }
+        if (current.kind == Kind::Atomic) {
+            return starts_outside(child_lists[number][0], set);
+        }
+
+        std::array<uint64_t, 4> first{};
+        if (current.is_byte()) {
+            first = current.byte_set();
+        } else if (current.kind == Kind::Repeat and current.min > 0 and nodes[child_lists[number][0]].is_byte()) {
+            first = nodes[child_lists[number][0]].byte_set();
+        } else {
+            return false;
+        }
+        for (size_t word = 0; word < set.size(); word++) {
+            if ((first[word] & set[word]) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Consumes a quantifier and sets its bounds, or returns false if there is none at the offset
+    constexpr bool parse_quantifier(int *min = nullptr, int *max = nullptr) {
+        int bounds[2] = {0, -1};
+        switch (peek()) {
+            case '+':
+                bounds[0] = 1;
+                break;
+            case '?':
+                bounds[1] = 1;
+                break;
+            case '*':
+                break;
+            case '{':
+                if (not parse_bounds(bounds[0], bounds[1])) {
+                    return false;
+                }
+                break;
+            default:
+                return false;
+        }
+        offset++;
+        if (min != nullptr) {
+            *min = bounds[0];
+            *max = bounds[1];
+        }
+        return true;
+    }
+
+    // '{n}', '{n,}' or '{n,m}', leaving the offset on the '}'; anything else is a literal '{'
+    constexpr bool parse_bounds(int &min, int &max) {
+        size_t end = offset + 1;
+        auto count = [&](int &value) {
+            const size_t first = end;
+            value = 0;
+            while (end < pattern.size() and pattern[end] >= '0' and pattern[end] <= '9') {
+                value = std::min(value * 10 + (pattern[end++] - '0'), MAX_COUNT + 1);
+            }
+            return end > first;
+        };
+
+        if (not count(min)) {
+            return false;
+        }
+        if (end < pattern.size() and pattern[end] == ',') {
+            end++;
+            if (not count(max)) {
+                max = -1;
+            }
+        } else {
+            max = min;
+        }
+        if (end == pattern.size() or pattern[end] != '}') {
+            return false;
+        }
+
+        if (min > MAX_COUNT or max > MAX_COUNT) {
+            invalid_pattern("repetition count too large", offset);
+        }
+        if (max >= 0 and min > max) {
+            invalid_pattern("invalid repetition bounds", offset);
+        }
+        offset = end;
+        return true;
+    }
+
+    constexpr int parse_atom() {
+        const size_t start = offset++;
+        Node node;
+        switch (pattern[start]) {
+            case '(':
+                return parse_group(start);
+            case '[':
+                return parse_class(start);
+            case '.':
+                node.kind = Kind::Class;
+                node.insert_range(0, 255);
+                return add(node);
+            case '^':
+                node.kind = Kind::Begin;
+                return add(node);
+            case '$':
+                node.kind = Kind::End;
+                return add(node);
+            case '\\':
+                return parse_escape(start);
+            default:
+                node.kind = Kind::Literal;
+                node.literal = pattern[start];
+                return add(node);
+        }
+    }
+
+    constexpr int parse_group(const size_t start) {
+        const bool atomic = pattern.substr(offset).starts_with("?>");
+        const int group = atomic ? -1 : group_count++;
+        if (atomic) {
+            offset += 2;
+        }
+        const std::vector<int> branches = parse_branches();
+        if (at_end()) {
+            invalid_pattern("unmatched '('", start);
+        }
+        offset++;
+
+        int node = branches.front();
+        if (branches.size() == 1) {
+            nodes[node].group = group;
+        } else {
+            Node alternation;
+            alternation.kind = Kind::Alternation;
+            alternation.group = group;
+            node = add(alternation);
+            child_lists[node] = branches;
+        }
+        return atomic ? wrap(Kind::Atomic, node) : node;
+    }
+
+    // Adds the bytes of \d or \w, or returns false for another escaped byte
+    static constexpr bool insert_escape(Node &node, const char escaped) {
+        if (escaped == 'd') {
+            node.insert_range('0', '9');
+            return true;
+        }
+        if (escaped == 'w') {
+            node.insert_range('0', '9');
+            node.insert_range('A', 'Z');
+            node.insert_range('a', 'z');
+            return true;
+        }
+        return false;
+    }
+
+    constexpr int parse_class(const size_t start) {
+        Node node;
+        node.kind = Kind::Class;
+        const bool negative = not at_end() and peek() == '^';
+        if (negative) {
+            offset++;
+        }
+
+        while (not at_end() and peek() != ']') {
+            char member = pattern[offset++];
+            if (member == '\\' and not at_end()) {
+                member = pattern[offset++];
+                if (insert_escape(node, member)) {
+                    continue;
+                }
+            }
+            node.insert_range(member, member);
+        }
+
+        if (at_end()) {
+            invalid_pattern("unterminated character class", start);
+        }
+        offset++;
+
+        if (negative) {
+            for (auto &word: node.bytes) {
+                word = ~word;
+            }
+        }
+        return add(node);
+    }
+
+    constexpr int parse_escape(const size_t start) {
+        if (at_end()) {
+            invalid_pattern("trailing backslash", start);
+        }
+
+        const char escaped = pattern[offset++];
+        Node node;
+        if (insert_escape(node, escaped)) {
+            node.kind = Kind::Class;
+            return add(node);
+        }
+        if (escaped < '0' or escaped > '9') {
+            node.kind = Kind::Literal;
+            node.literal = escaped;
+            return add(node);
+        }
+
+        int group = escaped - '0';
+        while (not at_end() and peek() >= '0' and peek() <= '9') {
+            group = std::min(group * 10 + (pattern[offset++] - '0'), MAX_GROUP);
+        }
+        backrefs.emplace_back(group, start);
+        node.kind = Kind::Backref;
+        node.group = group;
+        return add(node);
+    }
+
+public:
+    std::vector<Node> nodes;
+    std::vector<std::vector<int>> child_lists;
+    int root = 0;
+    int group_count = 1;
+
+    constexpr explicit Parser(const std::string_view pattern) : pattern(pattern) {
+        // Reserved for the root, so it comes first
+        add({});
+        std::vector<int> branches = parse_branches();
+        if (not at_end()) {
+            invalid_pattern("unmatched ')'", offset);
+        }
+        for (const auto &[group, reference_offset]: backrefs) {
+            if (group == 0 or group > group_count - 1) {
+                invalid_pattern("invalid back reference", reference_offset);
+            }
+        }
+
+        // An alternation at the top level captures nothing, as in tokenize().
+        if (branches.size() == 1) {
+            nodes[0] = nodes[branches.front()];
+            child_lists[0] = child_lists[branches.front()];
+            child_lists[branches.front()].clear();
+        } else {
+            Node alternation;
+            alternation.kind = Kind::Alternation;
+            const int node = add(alternation);
+            child_lists[node] = branches;
+            child_lists[0] = {node};
+        }
+        nodes[0].group = 0;
+    }
+
+    [[nodiscard]] constexpr bool has_backrefs() const {
+        return not backrefs.empty();
+    }
+};
+
+// Nodes of a pattern's tree, counting the one left over when the root takes over its only branch
+consteval size_t node_count(const std::string_view pattern) {
+    return Parser(pattern).nodes.size();
+}
+
+template <size_t NodeCount>
+consteval Tree<NodeCount> build_tree(const std::string_view pattern) {
+    const Parser parser(pattern);
+    Tree<NodeCount> tree;
+    int next_child = 0;
+    for (size_t node = 0; node < NodeCount; node++) {
+        tree.nodes[node] = parser.nodes[node];
+        tree.nodes[node].first_child = next_child;
+        tree.nodes[node].child_count = static_cast<int>(parser.child_lists[node].size());
+        for (const int child: parser.child_lists[node]) {
+            tree.children[next_child++] = child;
+        }
+    }
+    tree.group_count = parser.group_count;
+    tree.has_backrefs = parser.has_backrefs();
+    return tree;
+}
+
+}
+
+
+template <static_pattern::PatternText Text>
+class StaticPattern {
+private:
+    using Kind = static_pattern::Kind;
+
+    static constexpr auto tree =
+            static_pattern::build_tree<static_pattern::node_count(Text.view())>(Text.view());
+
+    // Capture slots, only kept for backreferences; the whole match is tracked by find()
+    static constexpr size_t SLOT_COUNT = tree.has_backrefs ? 2 * tree.group_count : 0;
+    static constexpr size_t UNSET = std::string_view::npos;
+
+    struct State {
+        std::string_view input;
+        std::array<size_t, SLOT_COUNT> slots;
+    };
+
+    static constexpr const static_pattern::Node &node(const int number) {
+        return tree.nodes[number];
+    }
+
+    static constexpr int child(const int number, const int index) {
+        return tree.children[node(number).first_child + index];
+    }
+
+    // Number of literals among the children of a sequence from the index-th on
+    static constexpr int literal_run(const int sequence, const int index) {
+        int run = 0;
+        while (index + run < node(sequence).child_count and node(child(sequence, index + run)).kind == Kind::Literal) {
+            run++;
+        }
+        return run;
+    }
+
+    // Bytes a match can start with, and whether it can be empty (or start anywhere, after a backreference)
+    struct FirstBytes {
+        std::array<uint64_t, 4> bytes{};
+        bool nullable = false;
+    };
+
+    static constexpr FirstBytes first_bytes(const int number) {
+        const auto &current = node(number);
+        FirstBytes first;
+        switch (current.kind) {
+            case Kind::Literal:
+                first.bytes[static_cast<unsigned char>(current.literal) >> 6] |=
+                        uint64_t{1} << (static_cast<unsigned char>(current.literal) & 63);
+                break;
+            case Kind::Class:
+                first.bytes = current.bytes;
+                break;
+            case Kind::Begin:
+            case Kind::End:
+                first.nullable = true;
+                break;
+            case Kind::Backref:
+                first.bytes.fill(~uint64_t{0});
+                first.nullable = true;
+                break;
+            case Kind::Sequence:
+                first.nullable = true;
+                for (int index = 0; index < current.child_count and first.nullable; index++) {
+                    const FirstBytes next = first_bytes(child(number, index));
+                    for (size_t word = 0; word < first.bytes.size(); word++) {
+                        first.bytes[word] |= next.bytes[word];
+                    }
+                    first.nullable = next.nullable;
+                }
+                break;
+            case Kind::Alternation:
+                for (int index = 0; index < current.child_count; index++) {
+                    const FirstBytes branch = first_bytes(child(number, index));
+                    for (size_t word = 0; word < first.bytes.size(); word++) {
+                        first.bytes[word] |= branch.bytes[word];
+                    }
+                    first.nullable = first.nullable or branch.nullable;
+                }
+                break;
+            case Kind::Repeat:
+            case Kind::Atomic:
+                first = first_bytes(child(number, 0));
+                first.nullable = first.nullable or (current.kind == Kind::Repeat and current.min == 0);
+                break;
+        }
+        return first;
+    }
+
+    static constexpr FirstBytes FIRST = first_bytes(0);
+
+    // The only byte a match can start with, or -1
+    static constexpr int single_first_byte() {
+        int found = -1;
+        for (int byte = 0; byte < 256; byte++) {
+            if ((FIRST.bytes[byte >> 6] >> (byte & 63)) & 1) {
+                if (found >= 0) {
+                    return -1;
+                }
+                found = byte;
+            }
+        }
+        return FIRST.nullable ? -1 : found;
+    }
+
+    static constexpr bool anchored() {
+        return node(0).child_count > 0 and node(child(0, 0)).kind == Kind::Begin;
+    }
+
+    template <int Sequence, int Index, size_t... Offsets>
+    static bool match_literals(const std::string_view input, const size_t position, std::index_sequence<Offsets...>) {
+        return ((input[position + Offsets] == node(child(Sequence, Index + Offsets)).literal) and ...);
+    }
+
+    // Matches the children of a sequence from the index-th on, then calls next
+    template <int Sequence, int Index, typename Next>
+    static bool match_sequence(State &state, const size_t position, const Next &next) {
+        if constexpr (Index == node(Sequence).child_count) {
+            return next(position);
+        } else if constexpr (constexpr int run = literal_run(Sequence, Index); run > 1) {
+            return state.input.size() - position >= run and
+                   match_literals<Sequence, Index>(state.input, position, std::make_index_sequence<run>()) and
+                   match_sequence<Sequence, Index + run>(state, position + run, next);
+        } else {
+            return match_node<child(Sequence, Index)>(state, position, [&](const size_t after) {
+                return match_sequence<Sequence, Index + 1>(state, after, next);
+            });
+        }
+    }
+
+    template <int Alternation, size_t... Branches, typename Next>
+    static bool match_branches(State &state, const size_t position, const Next &next, std::index_sequence<Branches...>) {
+        return (match_node<child(Alternation, Branches)>(state, position, next) or ...);
+    }
+
+    // Greedy repetitions from the count-th on. Past min, an iteration matching the empty string ends an
+    // unbounded repetition, as in the other engines.
+    template <int Repetition, typename Next>
+    static bool match_repetitions(State &state, const size_t position, const int count, const Next &next) {
+        constexpr int min = node(Repetition).min;
+        constexpr int max = node(Repetition).max;
+        const bool repeated = (max < 0 or count < max) and match_node<child(Repetition, 0)>(state, position, [&](const size_t after) {
+            if (max < 0 and count + 1 >= min and after == position) {
+                return next(after);
+            }
+            return match_repetitions<Repetition>(state, after, count + 1, next);
+        });
+        return repeated or (count >= min and next(position));
+    }
+
+    template <int Repetition, typename Next>
+    static bool match_repeated(State &state, const size_t position, const Next &next) {
+        constexpr int repeated = child(Repetition, 0);
+        if constexpr (node(repeated).is_byte()) {
+            constexpr int max = node(Repetition).max;
+            const size_t limit = max < 0 ? state.input.size() : std::min(state.input.size(), position + max);
+            size_t end = position;
+            while (end < limit and match_byte<repeated>(state.input[end])) {
+                end++;
+            }
+
+            const size_t shortest = position + node(Repetition).min;
+            if (end < shortest) {
+                return false;
+            }
+            for (size_t after = end;; after--) {
+                if (next(after)) {
+                    return true;
+                }
+                if (after == shortest) {
+                    return false;
+                }
+            }
+        } else {
+            return match_repetitions<Repetition>(state, position, 0, next);
+        }
+    }
+
+    template <int Number>
+    static bool match_byte(const char byte) {
+        if constexpr (node(Number).kind == Kind::Literal) {
+            return byte == node(Number).literal;
+        } else {
+            return node(Number).contains(static_cast<unsigned char>(byte));
+        }
+    }
+
+    // Records the span of a capturing node in its slots once body matched, undoing it on failure. Until
+    // then a backreference inside body sees the span of the previous iteration.
+    template <int Number, typename Body, typename Next>
+    static bool capture(State &state, const size_t position, const Body &body, const Next &next) {
+        constexpr int group = node(Number).group;
+        if constexpr (group < 0 or SLOT_COUNT == 0) {
+            return body(next);
+        } else {
+            return body([&](const size_t after) {
+                const size_t saved_begin = std::exchange(state.slots[2 * group], position);
+                const size_t saved_end = std::exchange(state.slots[2 * group + 1], after);
+                if (next(after)) {
+                    return true;
+                }
+                state.slots[2 * group] = saved_begin;
+                state.slots[2 * group + 1] = saved_end;
+                return false;
+            });
+        }
+    }
+
+    // Calls next with each position where the node can end a match started at position, most preferred
+    // first, until next returns true
+    template <int Number, typename Next>
+    static bool match_node(State &state, const size_t position, const Next &next) {
+        constexpr Kind kind = node(Number).kind;
+        if constexpr (kind == Kind::Sequence) {
+            return capture<Number>(state, position, [&](const auto &then) {
+                return match_sequence<Number, 0>(state, position, then);
+            }, next);
+        } else if constexpr (kind == Kind::Alternation) {
+            return capture<Number>(state, position, [&](const auto &then) {
+                return match_branches<Number>(state, position, then,
+                                              std::make_index_sequence<node(Number).child_count>());
+            }, next);
+        } else if constexpr (kind == Kind::Repeat) {
+            return match_repeated<Number>(state, position, next);
+        } else if constexpr (kind == Kind::Atomic) {
+            // The captures of the only way tried are undone if the rest fails.
+            const auto saved = state.slots;
+            size_t end = 0;
+            if (not match_node<child(Number, 0)>(state, position, [&](const size_t after) {
+                end = after;
+                return true;
+            })) {
+                return false;
+            }
+            if (next(end)) {
+                return true;
+            }
+            state.slots = saved;
+            return false;
+        } else if constexpr (kind == Kind::Literal or kind == Kind::Class) {
+            return position < state.input.size() and match_byte<Number>(state.input[position]) and next(position + 1);
+        } else if constexpr (kind == Kind::Begin) {
+            return position == 0 and next(position);
+        } else if constexpr (kind == Kind::End) {
+            return position == state.input.size() and next(position);
+        } else {
+            // A group that did not take part (or is still open) matches the empty string.
+            constexpr int group = node(Number).group;
+            const size_t begin = state.slots[2 * group];
+            const size_t end = state.slots[2 * group + 1];
+            const std::string_view captured = (begin == UNSET or end == UNSET or begin > end)
+                                              ? std::string_view() : state.input.substr(begin, end - begin);
+            return state.input.substr(position).starts_with(captured) and next(position + captured.size());
+        }
+    }
+
+public:
+    // Capture groups, the whole match included
+    static constexpr int group_count = tree.group_count;
+
+    // Span of the leftmost-first match starting at from or after it, or nullopt if there is none
+    static std::optional<Span> find(const std::string_view input, const size_t from = 0) {
+        State state{input, {}};
+        for (size_t start = from; start <= input.size(); start++) {
+            if constexpr (anchored()) {
+                if (start > 0) {
+                    break;
+                }
+            }
+            // Positions where no match can start are skipped.
+            if constexpr (single_first_byte() >= 0) {
+                const void *found = std::memchr(input.data() + start, single_first_byte(), input.size() - start);
+                if (found == nullptr) {
+                    break;
+                }
+                start = static_cast<const char *>(found) - input.data();
+            } else if constexpr (not FIRST.nullable) {
+                while (start < input.size() and not ((FIRST.bytes[static_cast<unsigned char>(input[start]) >> 6] >>
+                                                      (static_cast<unsigned char>(input[start]) & 63)) & 1)) {
+                    start++;
+                }
+                if (start == input.size()) {
+                    break;
+                }
+            }
+
+            state.slots.fill(UNSET);
+            size_t end = start;
+            if (match_node<0>(state, start, [&](const size_t after) {
+                end = after;
+                return true;
+            })) {
+                return Span(start, end);
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Checks whether the pattern matches anywhere in the input
+    static bool match(const std::string_view input) {
+        return find(input).has_value();
+    }
+};
+
+#endif //STATIC_PATTERN_HPP
@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed set of worker threads, each with its own task deque. A worker runs the newest task of its own
+// deque first and, once it is empty, steals the oldest task of another worker, so tasks submitted
+// from a task (subdirectories of a directory being walked) stay local until someone is idle.
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex idle_mutex;
+    std::condition_variable wake;    // a task was queued, or the pool is stopping
+    std::condition_variable settled; // pending dropped to 0
+    std::atomic<size_t> queued = 0;  // tasks waiting in a deque
+    std::atomic<size_t> pending = 0; // tasks queued or running
+    std::atomic<size_t> next_worker = 0;
+    bool stopping = false;
+
+    void run(size_t self);
+
+    bool take(size_t self, Task &task);
+
+public:
+    // Starts the given number of workers, at least one
+    explicit ThreadPool(size_t thread_count);
+
+    // Queues a task: on the calling worker's own deque when called from a task, otherwise round-robin
+    void submit(Task task);
+
+    [[nodiscard]] size_t size() const {
+        return threads.size();
+    }
+
+    // Blocks until every submitted task, including those they submitted, has run
+    void wait();
+
+    ~ThreadPool();
+};
+
+#endif //THREAD_POOL_HPP
@@ -0,0 +1,157 @@
+#ifndef TRIGRAM_INDEX_HPP
+#define TRIGRAM_INDEX_HPP
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "input.hpp"
+#include "trigrams.hpp"
+
+
+// On-disk index of the trigrams of a set of files, so repeated searches only read the parts of the
+// files that may match. Files are cut into blocks of whole lines of about BLOCK_SIZE bytes (compressed
+// files are a single block), and every trigram maps to the blocks containing it. Trigrams spanning a
+// newline are left out, since lines are matched one at a time. The index is memory-mapped; its layout,
+// in native byte order, is
+//
+//     header    magic, counts and section offsets
+//     files     size, modification time, hash of the last bytes, blocks and path of each file
+//     blocks    offset, length, first line and line count of each block, in file order
+//     trigrams  trigram, posting count and postings offset, sorted by trigram
+//     postings  ascending block numbers of each trigram, as LEB128 deltas
+class TrigramIndex {
+public:
+    struct File {
+        std::string path;
+        uint64_t size = 0;      // bytes indexed
+        int64_t mtime = 0;      // modification time when indexed, in nanoseconds
+        uint64_t tail_hash = 0; // hash of the last TAIL_SIZE bytes indexed, to recognize appends
+        bool compressed = false;
+        uint32_t first_block = 0;
+        uint32_t block_count = 0;
+    };
+
+    struct Block {
+        uint64_t offset;
+        uint64_t length;
+        uint64_t first_line; // number of its first line in the file, from 1
+        uint64_t line_count;
+        uint32_t file;
+    };
+
+    // How a file on disk compares with its indexed version
+    enum class Change {
+        Unchanged,
+        Appended, // grew, and the bytes indexed are still there: only the new lines need reading
+        Changed,  // rewritten, truncated or recompressed: the index says nothing about it anymore
+        Missing,  // can't be opened; errno is set
+    };
+
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+    static constexpr size_t TAIL_SIZE = 4096;
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    std::vector<File> files;
+    size_t block_count = 0;
+    size_t trigram_count = 0;
+    size_t blocks_offset = 0;
+    size_t trigrams_offset = 0;
+    size_t postings_offset = 0;
+
+    TrigramIndex() = default;
+
+public:
+    TrigramIndex(const TrigramIndex &) = delete;
+    TrigramIndex &operator=(const TrigramIndex &) = delete;
+
+    // Maps an index file. Returns nullptr and leaves errno set on failure, EINVAL if the file is not
+    // an index.
+    static std::unique_ptr<TrigramIndex> open(const std::string &path);
+
+    [[nodiscard]] const std::vector<File> &indexed_files() const {
+        return files;
+    }
+
+    [[nodiscard]] size_t blocks() const {
+        return block_count;
+    }
+
+    [[nodiscard]] Block block(size_t number) const;
+
+    [[nodiscard]] size_t trigrams() const {
+        return trigram_count;
+    }
+
+    // Ascending numbers of the blocks containing the trigram
+    [[nodiscard]] std::vector<uint32_t> postings(uint32_t trigram) const;
+
+    // Calls on_trigram with every trigram and its blocks, in trigram order
+    void for_each_trigram(const std::function<void(uint32_t trigram, const std::vector<uint32_t> &blocks)> &on_trigram) const;
+
+    // Ascending numbers of the blocks that may hold a line satisfying the query, or nullopt if any
+    // block may
+    [[nodiscard]] std::optional<std::vector<uint32_t>> candidates(const TrigramQuery &query) const;
+
+    // Compares the file on disk with its indexed version
+    static Change change_of(const File &file);
+
+    ~TrigramIndex();
+};
+
+// Work done by update_index
+struct IndexUpdate {
+    size_t unchanged = 0; // files whose blocks were kept
+    size_t appended = 0;  // files of which only the new lines were read
+    size_t indexed = 0;   // files read from scratch
+    size_t skipped = 0;   // binary files, left out like -r does
+};
+
+// Writes the index of the files to path, replacing it atomically. An index already there is reused:
+// unchanged files keep their blocks, and files that were appended to only have their last block and
+// new lines read. Files that can't be read are reported to on_error, with errno set, and left out.
+// Returns false, with errno set, if the index can't be read or written.
+bool update_index(const std::string &path, const std::vector<std::string> &files,
+                  const std::function<void(const std::string &path)> &on_error, IndexUpdate &update);
+
+// Indexed file read only where the index allows: some byte ranges, each made of whole lines. The
+// file is only opened if there is a range to read.
+class IndexedSource : public InputSource {
+public:
+    struct Range {
+        uint64_t offset;
+        uint64_t length; // clipped to the end of the file
+        uint64_t first_line;
+    };
+
+private:
+    std::vector<Range> ranges;
+    size_t next_range = 0;
+    const char *data = nullptr;
+    size_t size = 0;
+    bool error = false;
+    size_t current_first_line = 0;
+
+public:
+    IndexedSource(std::string path, std::vector<Range> ranges);
+
+    [[nodiscard]] std::string_view next_block() override;
+
+    [[nodiscard]] bool failed() const override {
+        return error;
+    }
+
+    [[nodiscard]] size_t block_first_line() const override {
+        return current_first_line;
+    }
+
+    ~IndexedSource() override;
+};
+
+#endif //TRIGRAM_INDEX_HPP
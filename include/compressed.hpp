@@ -0,0 +1,107 @@
+#ifndef COMPRESSED_HPP
+#define COMPRESSED_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "input.hpp"
+
+
+// Compression format of an input, recognized by its magic bytes
+enum class Compression {
+    None,
+    Gzip,
+    Zstd, // only decoded by builds with ZSTD=1
+};
+
+// Format of an input starting with these bytes (4 are enough)
+Compression detect_compression(std::string_view magic);
+
+// Whether these first bytes of an input are too few to tell its format, being the start of some magic bytes
+bool starts_magic(std::string_view bytes);
+
+// Whether this build can decode the format
+bool can_decompress(Compression compression);
+
+// Streaming decoder of one compression format. Concatenated streams (gzip members, zstd frames) are
+// decoded as one.
+class Decoder {
+public:
+    struct Progress {
+        size_t consumed;
+        size_t produced;
+    };
+
+    // Decodes input into output as far as both allow, or returns nullopt if the data is corrupt
+    [[nodiscard]] virtual std::optional<Progress> decode(std::string_view input, char *output, size_t capacity) = 0;
+
+    // Whether the data decoded so far ends a stream, so the input may end here
+    [[nodiscard]] virtual bool at_boundary() const = 0;
+
+    virtual ~Decoder() = default;
+
+    static std::unique_ptr<Decoder> create(Compression compression);
+};
+
+// Compressed input decoded on a dedicated thread, so decompression overlaps with matching. The thread
+// fills a ring of reusable buffers with whole lines; next_block() hands them out in order and takes
+// back the previous one.
+class CompressedSource : public InputSource {
+private:
+    struct Buffer {
+        std::vector<char> data;
+        size_t size = 0; // bytes of whole lines
+    };
+
+    int fd;
+    bool owns_fd;
+    std::string prefix; // bytes already read from fd to detect the format
+    std::unique_ptr<Decoder> decoder;
+
+    std::vector<Buffer> ring;
+    std::deque<size_t> free_buffers;  // ready to be filled
+    std::deque<size_t> ready_buffers; // filled, in input order
+    std::optional<size_t> in_use;     // returned by the last next_block()
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool finished = false; // the thread is done, and has filled its last buffer
+    bool stopping = false; // the reader went away
+    int error = 0;         // errno of a read error, or EILSEQ for corrupt or truncated data
+    int reported_error = 0; // error, once next_block() reached the end of input
+    std::thread decoder_thread;
+
+    // Body of the decoder thread
+    void decode_all();
+
+    // Waits for a buffer to fill, or returns nullopt when stopping
+    std::optional<size_t> acquire_free();
+
+    void publish(size_t buffer);
+
+    void finish(int error_number);
+
+public:
+    static constexpr size_t RING_SIZE = 4;
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+    static constexpr size_t READ_SIZE = 256 << 10;
+
+    CompressedSource(std::string name, int fd, bool owns_fd, Compression compression, std::string prefix);
+
+    [[nodiscard]] std::string_view next_block() override;
+
+    [[nodiscard]] bool failed() const override {
+        return reported_error != 0;
+    }
+
+    ~CompressedSource() override;
+};
+
+#endif //COMPRESSED_HPP
@@ -0,0 +1,35 @@
+#ifndef DAEMON_HPP
+#define DAEMON_HPP
+
+#include <functional>
+#include <string>
+
+#include "input.hpp"
+#include "options.hpp"
+#include "PatternSet.hpp"
+
+
+// Searches one input for a request, formatting the results like the command line would into output.
+// Returns the exit status grep would have: 0 if a line matched, 1 if none did, 3 if some were skipped.
+using RequestSearch = std::function<int(const PatternSet &pattern, const Options &options, InputSource &source,
+                                        std::string &output)>;
+
+// Serves searches on the Unix socket options.daemon_socket until SIGINT or SIGTERM, and returns the
+// exit status of the daemon. An epoll loop on the calling thread reads requests and writes responses;
+// the searches run on a pool of options.threads workers, with compiled patterns kept in an LRU cache.
+//
+// A connection carries any number of requests, answered in order. A request is a header line followed
+// by the pattern text (one pattern per line, like -f) and the payload:
+//
+//     data|file <pattern size> <payload size> [flags]\n<pattern><payload>
+//
+// The payload of `data` is the text searched; that of `file` is the path of a file the daemon opens.
+// The optional flags are letters of the options -c, -l, -n, -o and -q, such as `cn`. The response is
+//
+//     <status> <body size>\n<body>
+//
+// where status is the exit status of the same search on the command line, and body its output, or
+// the error message when status is 2.
+int run_daemon(const Options &options, const RequestSearch &search);
+
+#endif //DAEMON_HPP
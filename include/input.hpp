@@ -0,0 +1,142 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Source of input blocks. Every block ends on a line boundary (or at the end of input), so
+// lines never straddle two blocks.
+class InputSource {
+public:
+    std::string name;
+
+    explicit InputSource(std::string _name) : name(std::move(_name)) {}
+
+    // Returns the next block of whole lines, or an empty view at the end of input.
+    [[nodiscard]] virtual std::string_view next_block() = 0;
+
+    // True if a read error occurred; errno describes it.
+    [[nodiscard]] virtual bool failed() const = 0;
+
+    // Line number of the first line of the last block, for sources that skip parts of their input;
+    // 0 when blocks follow each other.
+    [[nodiscard]] virtual size_t block_first_line() const {
+        return 0;
+    }
+
+    virtual ~InputSource() = default;
+};
+
+// Regular file mapped into memory and returned as a single block
+class MappedSource : public InputSource {
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    bool consumed = false;
+
+public:
+    MappedSource(std::string name, int fd, size_t size);
+
+    [[nodiscard]] bool mapped() const {
+        return data != nullptr;
+    }
+
+    [[nodiscard]] std::string_view next_block() override;
+
+    [[nodiscard]] bool failed() const override {
+        return false;
+    }
+
+    ~MappedSource() override;
+};
+
+// Text already in memory, such as the data of a daemon request, returned as a single block
+class MemorySource : public InputSource {
+private:
+    std::string_view text;
+    bool consumed = false;
+
+public:
+    MemorySource(std::string name, std::string_view text);
+
+    [[nodiscard]] std::string_view next_block() override;
+
+    [[nodiscard]] bool failed() const override {
+        return false;
+    }
+};
+
+// Pipe, terminal or any other stream read in large chunks
+class StreamSource : public InputSource {
+private:
+    int fd;
+    bool owns_fd;
+    bool eof = false;
+    bool error = false;
+    std::vector<char> buffer;
+    size_t begin = 0; // start of the unread partial line
+    size_t end = 0;   // end of valid data
+
+public:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    // prefix holds bytes already read from fd, returned first
+    StreamSource(std::string name, int fd, bool owns_fd, std::string_view prefix = {});
+
+    [[nodiscard]] std::string_view next_block() override;
+
+    [[nodiscard]] bool failed() const override {
+        return error;
+    }
+
+    ~StreamSource() override;
+};
+
+// Opens a file operand ("-" is stdin). Compressed files are decompressed transparently. Returns nullptr
+// and leaves errno set on failure.
+std::unique_ptr<InputSource> open_input(const std::string &path);
+
+// Whether a file whose first block this is holds binary data: text never contains a NUL byte, and
+// looking at the start is enough, like grep and git do.
+inline bool looks_binary(std::string_view first_block) {
+    constexpr size_t PROBE_SIZE = 8192;
+    return std::memchr(first_block.data(), '\0', std::min(first_block.size(), PROBE_SIZE)) != nullptr;
+}
+
+// Number of '\n' bytes in the text
+inline size_t count_newlines(std::string_view text) {
+    size_t count = 0;
+    const char *position = text.data();
+    const char *end = text.data() + text.size();
+
+    while (const auto *newline = static_cast<const char *>(std::memchr(position, '\n', end - position))) {
+        count++;
+        position = newline + 1;
+    }
+    return count;
+}
+
+// Calls on_line for every line of the block, without the trailing '\n'. Stops early and returns
+// false as soon as on_line returns false.
+template <typename OnLine>
+bool for_each_line(std::string_view block, OnLine &&on_line) {
+    while (not block.empty()) {
+        const auto *newline = static_cast<const char *>(std::memchr(block.data(), '\n', block.size()));
+        const size_t length = (newline != nullptr) ? newline - block.data() : block.size();
+
+        if (not on_line(block.substr(0, length))) {
+            return false;
+        }
+
+        block.remove_prefix((newline != nullptr) ? length + 1 : length);
+    }
+
+    return true;
+}
+
+#endif //INPUT_HPP
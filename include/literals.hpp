@@ -0,0 +1,72 @@
+#ifndef LITERALS_HPP
+#define LITERALS_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Literal strings that every match of a pattern must contain, collected from the token tree
+class RequiredLiterals {
+private:
+    std::vector<std::string> literals;
+    std::string run;    // literal being extended by consecutive Literal tokens
+    bool exact = true;  // the pattern so far is nothing but the literals collected
+
+public:
+    // Extend the current run with a character every match contains at this point. Lines never
+    // contain a newline, so it can't be part of a literal searched for in whole buffers.
+    void append(const char literal) {
+        if (literal == '\n') {
+            break_run();
+            return;
+        }
+        run += literal;
+    }
+
+    // The next token may match anything: end the current run
+    void break_run() {
+        if (not run.empty()) {
+            literals.push_back(std::move(run));
+            run.clear();
+        }
+        exact = false;
+    }
+
+    // The token consumes nothing but restricts where a match may be
+    void mark_inexact() {
+        exact = false;
+    }
+
+    // Returns the collected literals, ordered from the rarest to the most common
+    std::vector<std::string> finish();
+
+    // Whether the pattern is exactly the single literal returned by finish()
+    [[nodiscard]] bool is_exact() const {
+        return exact;
+    }
+};
+
+// Estimated frequency of a byte in typical text and logs; lower is rarer
+int byte_frequency(unsigned char byte);
+
+// Substring search for a fixed literal. Candidates are found by looking for the two rarest bytes of the
+// literal at once (SSE2 when available, memchr otherwise), then verified with memcmp.
+class LiteralSearcher {
+private:
+    std::string needle;
+    size_t rare_first = 0;  // offset of the rarest byte of the needle
+    size_t rare_second = 0; // offset of the second rarest byte
+
+public:
+    explicit LiteralSearcher(std::string needle);
+
+    [[nodiscard]] const std::string &literal() const {
+        return needle;
+    }
+
+    // Position of the first occurrence at or after from, or std::string_view::npos
+    [[nodiscard]] size_t find(std::string_view haystack, size_t from = 0) const;
+};
+
+#endif //LITERALS_HPP
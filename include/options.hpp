@@ -0,0 +1,38 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <string>
+#include <vector>
+
+#include "CompiledPattern.hpp"
+#include "parallel.hpp"
+#include "PatternCache.hpp"
+
+
+// Command line configuration of a search
+struct Options {
+    std::vector<std::string> patterns; // a line matches if any of them does
+    std::vector<std::string> files;
+    PatternConfig pattern_config;
+    bool debug = false;     // dump the token tree to std::cerr
+    bool quiet = false;         // -q: print nothing, stop at the first match
+    bool list_files = false;    // -l: print the name of each file with a match
+    bool count = false;         // -c: print the number of matching lines of each file
+    bool only_matching = false; // -o: print every match on its own line instead of whole lines
+    bool line_numbers = false;  // -n: prefix lines with their number
+    bool recursive = false; // search directory operands and everything below them
+    size_t threads = 0;     // threads searching in recursive mode, 0 for one per core
+    size_t chunk_size = DEFAULT_CHUNK_SIZE; // bytes of a large file scanned by one task of the pool
+    bool stats = false;     // report the work done as JSON (builds with STATS=1 only)
+    std::string stats_path; // file receiving the report, std::cerr if empty
+    std::string daemon_socket; // serve requests on this Unix socket instead of searching once
+    size_t pattern_cache_size = PatternCache::DEFAULT_CAPACITY; // compiled patterns kept by the daemon
+    std::string index_path; // trigram index searched instead of the operands, or built from them
+    bool build_index = false; // build or update the index at index_path instead of searching
+};
+
+// Parses the command line into options. Prints the problem to std::cerr and returns false on invalid
+// arguments.
+bool parse_options(int argc, char *argv[], Options &options);
+
+#endif //OPTIONS_HPP
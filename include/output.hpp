@@ -0,0 +1,61 @@
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+
+// Buffered writer to a file descriptor. Text larger than the room left in the buffer is written
+// with writev straight from where it lies, after the buffered bytes, so long lines of a mapped file
+// are never copied.
+class BufferedWriter {
+private:
+    int fd;
+    std::vector<char> buffer;
+    size_t used = 0;
+    bool error = false;
+
+    // Writes the buffer, then text, with as few system calls as possible
+    void write_through(std::string_view text);
+
+public:
+    static constexpr size_t BUFFER_SIZE = 256 << 10;
+
+    explicit BufferedWriter(int fd) : fd(fd), buffer(BUFFER_SIZE) {}
+
+    BufferedWriter(const BufferedWriter &) = delete;
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+    void append(const std::string_view text) {
+        if (text.size() <= buffer.size() - used) {
+            std::memcpy(buffer.data() + used, text.data(), text.size());
+            used += text.size();
+        } else {
+            write_through(text);
+        }
+    }
+
+    // Writes out everything buffered, returns false if a write failed (now or earlier)
+    bool flush();
+
+    ~BufferedWriter() {
+        flush();
+    }
+};
+
+// Appends the decimal digits of value to output, a BufferedWriter or a std::string
+template <typename Output>
+void append_number(Output &output, const size_t value) {
+    char digits[20];
+    char *begin = digits + sizeof(digits);
+    size_t rest = value;
+    do {
+        *--begin = static_cast<char>('0' + rest % 10);
+        rest /= 10;
+    } while (rest != 0);
+
+    output.append(std::string_view(begin, digits + sizeof(digits) - begin));
+}
+
+#endif //OUTPUT_HPP
@@ -0,0 +1,102 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "search.hpp"
+#include "ThreadPool.hpp"
+
+
+constexpr size_t DEFAULT_CHUNK_SIZE = size_t(8) << 20;
+
+// Like for_each_numbered_match, scanning a large block on the pool. The block is cut into chunks of
+// about chunk_size bytes ending on newlines, which the workers scan while the calling thread hands
+// their matches to on_match in input order. Only a window of two chunks per worker is in flight, so
+// the matches held at once stay bounded whatever the block size. Blocks under two chunks, or a pool
+// of one thread, are scanned sequentially. Must not be called from a task of the same pool.
+template <typename Pattern, typename OnMatch>
+bool for_each_matching_line_parallel(const Pattern &pattern, std::string_view block, ThreadPool &pool,
+                                     size_t &line_number, OnMatch &&on_match,
+                                     const size_t chunk_size = DEFAULT_CHUNK_SIZE) {
+    if (block.size() < 2 * chunk_size or pool.size() < 2) {
+        return for_each_numbered_match(pattern, block, line_number, on_match);
+    }
+
+    // Matches are numbered from 0 within their chunk until the chunks before it are counted.
+    struct Chunk {
+        std::string_view text;
+        std::vector<LineMatch> matches;
+        size_t lines = 0;
+        bool done = false;
+    };
+
+    const size_t window = 2 * pool.size();
+    std::vector<Chunk> ring(window);
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    size_t next_begin = 0;
+    size_t submitted = 0;
+
+    auto submit_next = [&] {
+        size_t end = std::min(next_begin + chunk_size, block.size());
+        if (const auto *newline = static_cast<const char *>(std::memchr(block.data() + end, '\n', block.size() - end))) {
+            end = newline - block.data() + 1;
+        } else {
+            end = block.size();
+        }
+
+        Chunk &chunk = ring[submitted % window];
+        chunk = Chunk();
+        chunk.text = block.substr(next_begin, end - next_begin);
+        next_begin = end;
+        submitted++;
+
+        pool.submit([&pattern, &mutex, &finished, &chunk] {
+            size_t lines = 0;
+            for_each_numbered_match(pattern, chunk.text, lines, [&](const LineMatch &match) {
+                chunk.matches.push_back(match);
+                return true;
+            });
+
+            std::lock_guard lock(mutex);
+            chunk.lines = lines;
+            chunk.done = true;
+            finished.notify_all();
+        });
+    };
+
+    while (submitted < window and next_begin < block.size()) {
+        submit_next();
+    }
+
+    // Chunks already submitted are waited for even after on_match stopped, since they use the ring.
+    bool completed = true;
+    for (size_t consumed = 0; consumed < submitted; consumed++) {
+        Chunk &chunk = ring[consumed % window];
+        {
+            std::unique_lock lock(mutex);
+            finished.wait(lock, [&] {
+                return chunk.done;
+            });
+        }
+
+        for (size_t index = 0; completed and index < chunk.matches.size(); index++) {
+            completed = on_match(LineMatch{line_number + chunk.matches[index].number, chunk.matches[index].line});
+        }
+        line_number += chunk.lines;
+
+        if (completed and next_begin < block.size()) {
+            submit_next();
+        }
+    }
+
+    return completed;
+}
+
+#endif //PARALLEL_HPP
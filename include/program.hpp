@@ -0,0 +1,109 @@
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ByteClass.hpp"
+#include "tokens.hpp"
+
+
+enum class Opcode : uint8_t {
+    Char,        // consume `literal`
+    Class,       // consume a byte in classes[argument]
+    Any,         // consume any byte
+    Split,       // continue at `argument`, then at `alternative` (in priority order)
+    Jump,        // continue at `argument`
+    Save,        // record the position in capture slot `argument`
+    AssertBegin, // succeed at the start of input
+    AssertEnd,   // succeed at the end of input
+    Backref,     // consume the text captured by group `argument` (backtracker only)
+    Loop,        // like Split to `argument` then pc + 1, but only pc + 1 if the iteration begun at the
+                 // position in slot `alternative` consumed nothing
+    AtomicBegin, // open an atomic group; `argument` is 1 unless the compiler implied it
+    AtomicEnd,   // drop the alternatives left since the matching AtomicBegin (backtracker only)
+    Match,       // the whole pattern matched
+};
+
+struct Instruction {
+    Opcode opcode;
+    char literal = 0;
+    int argument = 0;
+    int alternative = 0;
+};
+
+// Flat program compiled from a token tree, the common input of every engine but the tree walk.
+// Group 0 is the whole match, group n is the n-th capture.
+struct Program {
+    std::vector<Instruction> instructions;
+    std::vector<ByteClass> classes;
+    int group_count = 1;
+    int loop_count = 0;        // slots past the captures, where Loop instructions find their iteration's start
+    bool has_backrefs = false; // only the backtracker runs Backref instructions
+    bool has_atomic = false;   // atomic groups written in the pattern, which change what matches
+    bool anchored = false;     // every match starts at position 0
+
+    [[nodiscard]] int slot_count() const {
+        return 2 * group_count;
+    }
+
+    [[nodiscard]] std::string to_string() const;
+};
+
+class ProgramBuilder {
+private:
+    Program program;
+    std::vector<std::pair<int, int>> loops; // pcs of the Save marking an iteration and of its Loop
+
+public:
+    // Index of the next instruction to be emitted
+    [[nodiscard]] int pc() const {
+        return static_cast<int>(program.instructions.size());
+    }
+
+    int emit(const Instruction &instruction) {
+        program.instructions.push_back(instruction);
+        return pc() - 1;
+    }
+
+    Instruction &at(const int pc) {
+        return program.instructions[pc];
+    }
+
+    // Emit an instruction consuming a single byte of the class
+    void emit_byte_set(const ByteClass &bytes);
+
+    // Register a capture group numbered by Token::number
+    void add_group(const int group) {
+        program.group_count = std::max(program.group_count, group + 1);
+    }
+
+    void mark_backrefs() {
+        program.has_backrefs = true;
+    }
+
+    void mark_atomic() {
+        program.has_atomic = true;
+    }
+
+    // Emit the Save marking where an iteration begins; its slot is numbered by finish()
+    int emit_loop_mark() {
+        loops.emplace_back(emit({Opcode::Save}), -1);
+        return static_cast<int>(loops.size()) - 1;
+    }
+
+    // Emit the Loop back to begin ending the iteration marked by emit_loop_mark()
+    void emit_loop(const int begin, const int mark) {
+        loops[mark].second = emit({Opcode::Loop, 0, begin});
+    }
+
+    Program finish();
+};
+
+// Compiles the root token returned by tokenize()
+Program compile_program(const Token &root);
+
+#endif //PROGRAM_HPP
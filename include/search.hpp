@@ -0,0 +1,99 @@
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+#include <cstring>
+#include <string_view>
+
+#include "CompiledPattern.hpp"
+#include "input.hpp"
+#include "PatternSet.hpp"
+
+
+// Calls on_match for every line of the block matched by the pattern, in order. When the pattern has
+// a required literal the block is scanned for it directly, so lines without it are never visited.
+// Stops early and returns false as soon as on_match returns false.
+template <typename OnMatch>
+bool for_each_matching_line(const CompiledPattern &pattern, std::string_view block, OnMatch &&on_match) {
+    const LiteralSearcher *prefilter = pattern.prefilter();
+
+    if (prefilter == nullptr) {
+        return for_each_line(block, [&](std::string_view line) {
+            return not pattern.match(line) or on_match(line);
+        });
+    }
+
+    // The line holds the literal just found, so match() only checks the other ones.
+    std::optional<LazyDFA> dfa;
+    size_t position = 0;
+    while (position < block.size()) {
+        const size_t found = prefilter->find(block, position);
+        if (found == std::string_view::npos) {
+            break;
+        }
+
+        // Widen the occurrence to the line holding it.
+        const auto *line_begin = static_cast<const char *>(memrchr(block.data() + position, '\n', found - position));
+        const size_t begin = (line_begin != nullptr) ? line_begin - block.data() + 1 : position;
+        const auto *line_end = static_cast<const char *>(std::memchr(block.data() + found, '\n', block.size() - found));
+        const size_t end = (line_end != nullptr) ? line_end - block.data() : block.size();
+
+        const std::string_view line = block.substr(begin, end - begin);
+        if (pattern.match_prefiltered(line, dfa) and not on_match(line)) {
+            return false;
+        }
+
+        position = end + 1;
+    }
+
+    return true;
+}
+
+// Calls on_match for every line of the block matched by any pattern of the set, in order. A single
+// pattern is searched on its own, with its literal searcher.
+template <typename OnMatch>
+bool for_each_matching_line(const PatternSet &patterns, std::string_view block, OnMatch &&on_match) {
+    if (patterns.size() == 1) {
+        return for_each_matching_line(patterns.front(), block, on_match);
+    }
+
+    size_t position = 0;
+    while (position < block.size()) {
+        const auto [begin, length] = patterns.find_line(block, position);
+        if (begin == std::string_view::npos) {
+            break;
+        }
+        if (not on_match(block.substr(begin, length))) {
+            return false;
+        }
+        position = begin + length + 1;
+    }
+
+    return true;
+}
+
+// Matching line and its number in the input, counted from 1
+struct LineMatch {
+    size_t number;
+    std::string_view line;
+};
+
+// Like for_each_matching_line, with on_match receiving each line as a LineMatch. line_number is the
+// number of the first line of the block on entry, and of the line following the block on return.
+template <typename Pattern, typename OnMatch>
+bool for_each_numbered_match(const Pattern &pattern, std::string_view block, size_t &line_number,
+                             OnMatch &&on_match) {
+    const char *counted = block.data(); // newlines before it are included in line_number
+
+    const bool completed = for_each_matching_line(pattern, block, [&](std::string_view line) {
+        line_number += count_newlines(std::string_view(counted, line.data() - counted));
+        counted = line.data();
+        return on_match(LineMatch{line_number, line});
+    });
+
+    if (completed) {
+        line_number += count_newlines(std::string_view(counted, block.data() + block.size() - counted));
+    }
+    return completed;
+}
+
+#endif //SEARCH_HPP
@@ -0,0 +1,138 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+
+// Work counted for --stats, once stats_enabled is set. Every build times the phases and counts the input,
+// once per block. The counters bumped per line or per state, from EngineCalls on, and the gauges only
+// exist in builds with GREP_STATS defined (make STATS=1); otherwise they are empty and inlined away, so
+// the matching loops pay nothing.
+enum class StatCounter {
+    BytesRead,
+    LinesRead,
+    EngineCalls,         // lines that reached an engine, past the prefilter
+    StartPositions,      // start positions tried by the tree walk and the backtracker
+    LevelCalls,          // get_matches invocations of the tree walk, per token type
+    AlternationCalls,
+    OneOrMoreCalls,
+    ZeroOrOneCalls,
+    RepeatCalls,
+    AtomicCalls,
+    LiteralCalls,
+    ByteClassCalls,
+    AnchorCalls,
+    BackrefCalls,
+    BackreferenceCopies, // capture slots copied on write by the tree walk
+    BacktrackSteps,      // instructions executed by the backtracker
+    AtomicDiscards,      // alternatives the backtracker dropped on leaving an atomic group
+    DfaStates,           // states built by the lazy DFA
+    DfaFallbacks,        // lines handed to the Pike VM because the DFA cache thrashed
+    BudgetFallbacks,     // lines handed to the Pike VM because backtracking exceeded its budget
+    BudgetExceeded,      // lines given up on for the same reason, the pattern having backreferences
+    Count,
+};
+
+// Maxima over the whole run
+enum class StatGauge {
+    RecursionDepth, // nested Level::match_here calls of the tree walk
+    BacktrackStack, // frames on the backtracker's stack
+    Count,
+};
+
+// Wall-clock time, summed over the threads doing the work
+enum class StatPhase {
+    Compile,
+    Io,
+    Match,
+    Count,
+};
+
+// Whether --stats asked for a report; set before any work starts
+inline bool stats_enabled = false;
+
+#ifdef GREP_STATS
+constexpr bool MATCHER_STATS_ENABLED = true;
+#else
+constexpr bool MATCHER_STATS_ENABLED = false;
+#endif
+
+void add_stat(StatCounter counter, uint64_t amount);
+
+// Counts work done by the matchers, nothing unless built with GREP_STATS
+inline void count_stat(const StatCounter counter, const uint64_t amount = 1) {
+    if constexpr (MATCHER_STATS_ENABLED) {
+        if (stats_enabled) {
+            add_stat(counter, amount);
+        }
+    }
+}
+
+void add_phase_time(StatPhase phase, std::chrono::steady_clock::duration time);
+
+// Counts the bytes and lines of an input block
+void count_input(std::string_view block);
+
+// Everything counted so far by every thread, as a JSON object
+std::string stats_json();
+
+// Adds the time until its destruction to a phase; used once per block or file, never per line
+class PhaseTimer {
+private:
+    StatPhase phase;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit PhaseTimer(const StatPhase phase) : phase(phase) {
+        if (stats_enabled) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+    ~PhaseTimer() {
+        if (stats_enabled) {
+            add_phase_time(phase, std::chrono::steady_clock::now() - start);
+        }
+    }
+};
+
+#ifdef GREP_STATS
+
+void raise_stat(StatGauge gauge, uint64_t value);
+
+// Tracks the nesting of the tree walk for StatGauge::RecursionDepth
+class DepthScope {
+private:
+    static inline thread_local uint64_t depth = 0;
+
+public:
+    DepthScope() {
+        raise_stat(StatGauge::RecursionDepth, ++depth);
+    }
+
+    DepthScope(const DepthScope &) = delete;
+    DepthScope &operator=(const DepthScope &) = delete;
+
+    ~DepthScope() {
+        depth--;
+    }
+};
+
+#else
+
+inline void raise_stat(StatGauge, uint64_t) {}
+
+class DepthScope {
+public:
+    DepthScope() {} // NOLINT(modernize-use-equals-default): keeps scopes from warning as unused
+};
+
+#endif
+
+#endif //STATS_HPP
@@ -1,42 +1,115 @@
 #ifndef TOKENS_HPP
 #define TOKENS_HPP
 
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "ByteClass.hpp"
 #include "utils.hpp"
 
 
-using matched_result = std::pair<Backreference, size_t>;
-using matched_results = std::vector<matched_result>;
+class ProgramBuilder;
+class RequiredLiterals;
+class TrigramQueryBuilder;
 
+// Non-owning reference to the rest of a match. It is called with the captures and position after a
+// token matched, and returns true once the whole pattern succeeded, which stops the enumeration.
+class MatchContinuation {
+private:
+    const void *callable;
+    bool (*invoke)(const void *, const Backreference &, size_t);
+
+public:
+    template <typename Callable>
+    requires (not std::is_same_v<std::decay_t<Callable>, MatchContinuation>)
+    MatchContinuation(const Callable &callable) // NOLINT(google-explicit-constructor)
+            : callable(&callable), invoke([](const void *target, const Backreference &backreference, size_t position) {
+                  return (*static_cast<const Callable *>(target))(backreference, position);
+              }) {}
+
+    bool operator()(const Backreference &backreference, const size_t position) const {
+        return invoke(callable, backreference, position);
+    }
+};
+
+// Numbers given to the tokens of a tree once it is built
+struct TokenNumbering {
+    int next_group = 0;     // capture groups, in pattern order
+    int next_memo_slot = 0; // (Level, child position) pairs remembered by MatchMemo
+};
+
+// Failed (Level, child position, input position) triples of a backtracking search over one line.
+// Without backreferences the rest of the match after a Level depends only on where it stands, so a
+// sequence that failed once from some position fails again from there, whatever the start position.
+class MatchMemo {
+private:
+    std::vector<uint64_t> bits;
+    size_t stride = 0;
+
+public:
+    static constexpr size_t MAX_BITS = size_t(1) << 26;
+
+    // Prepare for a line, returns false if the table would exceed MAX_BITS or memory_limit bytes
+    bool reset(const size_t slot_count, const size_t input_size, const size_t memory_limit) {
+        stride = input_size + 1;
+        if (slot_count * stride > MAX_BITS or slot_count * stride / 8 > memory_limit) {
+            return false;
+        }
 
-struct MatchResult {
-    bool add_backreference;
-    matched_results results;
+        bits.assign((slot_count * stride + 63) / 64, 0);
+        return true;
+    }
 
-    explicit MatchResult(bool _add_backreference = false, matched_results _results = {}) :
-            add_backreference(_add_backreference), results(std::move(_results)) {}
+    [[nodiscard]] bool failed(const int slot, const size_t position) const {
+        const size_t bit = static_cast<size_t>(slot) * stride + position;
+        return (bits[bit / 64] >> (bit % 64)) & 1;
+    }
 
-    void add_matched_result(const matched_result &matched) {
-        results.emplace_back(matched);
+    void mark_failed(const int slot, const size_t position) {
+        const size_t bit = static_cast<size_t>(slot) * stride + position;
+        bits[bit / 64] |= uint64_t(1) << (bit % 64);
     }
+};
+
+// Work left to the tree walk on one line. Running out of steps, or capture nodes outgrowing the memory
+// limit, aborts the walk by throwing WalkBudget::Exceeded.
+class WalkBudget {
+private:
+    size_t steps_left;
+    size_t memory_limit;
+    const CaptureArena &arena;
+
+public:
+    struct Exceeded {};
+
+    WalkBudget(const size_t steps, const size_t memory_limit, const CaptureArena &arena)
+            : steps_left(steps), memory_limit(memory_limit), arena(arena) {}
 
-    [[nodiscard]] bool has_matched() const {
-        return not results.empty();
+    void step() {
+        if (steps_left-- == 0 or arena.memory() > memory_limit) {
+            throw Exceeded();
+        }
     }
 };
 
+// Position in the input being matched. The input is only viewed: the caller keeps it alive for the
+// whole match, and every nested context points at the same characters.
 struct MatchContext {
-    std::string input;
+    std::string_view input;
     size_t position;
-    Backreference &backreference;
+    const Backreference &backreference;
+    MatchMemo *memo; // null when memoization is off or the continuation is not the pattern's own
+    WalkBudget *budget; // null when unlimited, like memo only set for the pattern's own continuations
 
-    MatchContext(std::string input, size_t position, Backreference &backreference)
-            : input(std::move(input)), position(position), backreference(backreference) {}
+    MatchContext(std::string_view input, size_t position, const Backreference &backreference,
+                 MatchMemo *memo = nullptr, WalkBudget *budget = nullptr)
+            : input(input), position(position), backreference(backreference), memo(memo), budget(budget) {}
 };
 
 
@@ -47,24 +120,74 @@ public:
 
     explicit Token(const int index) : index(index) {}
 
-    [[nodiscard]] virtual MatchResult get_matches(const MatchContext &context) const = 0;
+    // Calls next for each way this token matches at the context position, from the most to the least
+    // preferred, until next returns true. Returns whether it did.
+    virtual bool get_matches(const MatchContext &context, const MatchContinuation &next) const = 0;
+
+    // Whether the token matches at the context position at all. The memo is left out: it only holds
+    // for the continuations of the full pattern.
+    [[nodiscard]] bool matches_at(const MatchContext &context) const {
+        return get_matches(MatchContext(context.input, context.position, context.backreference),
+                           [](const Backreference &, size_t) {
+                               return true;
+                           });
+    }
 
     [[nodiscard]] virtual std::string to_string(int depth) const = 0;
 
+    // Emit the NFA instructions matching this token
+    virtual void compile(ProgramBuilder &builder) const = 0;
+
+    // Add the literals every match of this token contains; by default the token may match anything
+    virtual void collect_literals(RequiredLiterals &literals) const;
+
+    // Add the trigrams every match of this token contains, for the index; by default none
+    virtual void collect_trigrams(TrigramQueryBuilder &query) const;
+
+    // Number the capture groups (in pattern order) and the memo slots of the subtree
+    virtual void number(TokenNumbering &numbering);
+
+    // Bytes accepted by a token that always consumes exactly one byte from a fixed set, otherwise null
+    [[nodiscard]] virtual const ByteClass *byte_class() const {
+        return nullptr;
+    }
+
     virtual ~Token() = default;
 };
 
 // Token for matching a character or group of tokens
 class Level : public Token {
 private:
-    [[nodiscard]] matched_results match_here(const MatchContext &context, size_t tokens_pos) const;
+    bool match_here(const MatchContext &context, size_t tokens_pos, const MatchContinuation &next) const;
 
 public:
+    int group = -1; // capture group, -1 for the branches of an alternation
+    int memo_base = 0; // memo slot of the first child, one more slot per child follows
+
     explicit Level(const int index) : Token(index) {}
 
-    [[nodiscard]] MatchResult get_matches(const MatchContext &context) const override;
+    // Number the children and the memo slots without taking a capture group
+    void number_sequence(TokenNumbering &numbering);
+
+    // One past the last memo slot of the subtree; for the root, the size of the memo
+    [[nodiscard]] int memo_slot_end() const {
+        return memo_base + static_cast<int>(children.size()) + 1;
+    }
+
+    // Emit the children in order, without opening a capture group
+    void compile_sequence(ProgramBuilder &builder) const;
+
+    bool get_matches(const MatchContext &context, const MatchContinuation &next) const override;
 
     [[nodiscard]] std::string to_string(int depth) const override;
+
+    void compile(ProgramBuilder &builder) const override;
+
+    void collect_literals(RequiredLiterals &literals) const override;
+
+    void collect_trigrams(TrigramQueryBuilder &query) const override;
+
+    void number(TokenNumbering &numbering) override;
 };
 
 // Token for backreference
@@ -75,62 +198,89 @@ public:
     explicit Backref(const int index, const int backref_index) : Token(index), backref_index
             (backref_index) {}
 
-    [[nodiscard]] MatchResult get_matches(const MatchContext &context) const override;
+    bool get_matches(const MatchContext &context, const MatchContinuation &next) const override;
 
     [[nodiscard]] std::string to_string(int depth) const override;
+
+    void compile(ProgramBuilder &builder) const override;
 };
 
 // Token for matching literals
 class Literal : public Token {
 private:
     char literal;
+    ByteClass bytes; // the literal alone
 
 public:
-    explicit Literal(const int index, const char _literal) : Token(index), literal(_literal) {}
+    explicit Literal(int index, char _literal);
 
-    [[nodiscard]] MatchResult get_matches(const MatchContext &context) const override;
+    bool get_matches(const MatchContext &context, const MatchContinuation &next) const override;
 
     [[nodiscard]] std::string to_string(int depth) const override;
+
+    void compile(ProgramBuilder &builder) const override;
+
+    void collect_literals(RequiredLiterals &literals) const override;
+
+    void collect_trigrams(TrigramQueryBuilder &query) const override;
+
+    [[nodiscard]] const ByteClass *byte_class() const override {
+        return &bytes;
+    }
 };
 
-// Token for matching digits
-class Digit : public Token {
+// Base of the tokens matching one byte out of a fixed set, tested in the bitmap
+class ByteClassToken : public Token {
+protected:
+    ByteClass bytes;
+
 public:
-    explicit Digit(const int index) : Token(index) {}
+    explicit ByteClassToken(const int index) : Token(index) {}
+
+    bool get_matches(const MatchContext &context, const MatchContinuation &next) const override;
 
-    [[nodiscard]] MatchResult get_matches(const MatchContext &context) const override;
+    void compile(ProgramBuilder &builder) const override;
+
+    [[nodiscard]] const ByteClass *byte_class() const override {
+        return &bytes;
+    }
+};
+
+// Token for matching digits
+class Digit : public ByteClassToken {
+public:
+    explicit Digit(int index);
 
     [[nodiscard]] std::string to_string(int depth) const override;
 };
 
 // Token for matching alphanumeric characters
-class Alnum : public Token {
+class Alnum : public ByteClassToken {
 public:
-    explicit Alnum(const int index) : Token(index) {}
-
-    [[nodiscard]] MatchResult get_matches(const MatchContext &context) const override;
+    explicit Alnum(int index);
 
     [[nodiscard]] std::string to_string(int depth) const override;
 };
 
-// Token for matching positive character groups
-class PositiveCharacterGroup : public Token {
+// Token for matching positive character groups. The members are its children, so the bitmap is
+// filled in when the finished tree is numbered.
+class PositiveCharacterGroup : public ByteClassToken {
 public:
-    explicit PositiveCharacterGroup(const int index) : Token(index) {}
-
-    [[nodiscard]] MatchResult get_matches(const MatchContext &context) const override;
+    explicit PositiveCharacterGroup(const int index) : ByteClassToken(index) {}
 
     [[nodiscard]] std::string to_string(int depth) const override;
+
+    void number(TokenNumbering &numbering) override;
 };
 
-// Token for matching negative character groups
-class NegativeCharacterGroup : public Token {
+// Token for matching negative character groups, with the bitmap filled in like a positive group's
+class NegativeCharacterGroup : public ByteClassToken {
 public:
-    explicit NegativeCharacterGroup(const int index) : Token(index) {}
-
-    [[nodiscard]] MatchResult get_matches(const MatchContext &context) const override;
+    explicit NegativeCharacterGroup(const int index) : ByteClassToken(index) {}
 
     [[nodiscard]] std::string to_string(int depth) const override;
+
+    void number(TokenNumbering &numbering) override;
 };
 
 // Token for matching the beginning of input
@@ -138,9 +288,15 @@ class BeginAnchor : public Token {
 public:
     explicit BeginAnchor(const int index) : Token(index) {}
 
-    [[nodiscard]] MatchResult get_matches(const MatchContext &context) const override;
+    bool get_matches(const MatchContext &context, const MatchContinuation &next) const override;
 
     [[nodiscard]] std::string to_string(int depth) const override;
+
+    void compile(ProgramBuilder &builder) const override;
+
+    void collect_literals(RequiredLiterals &literals) const override;
+
+    void collect_trigrams(TrigramQueryBuilder &query) const override;
 };
 
 // Token for matching the end of input
@@ -148,9 +304,15 @@ class EndAnchor : public Token {
 public:
     explicit EndAnchor(const int index) : Token(index) {}
 
-    [[nodiscard]] MatchResult get_matches(const MatchContext &context) const override;
+    bool get_matches(const MatchContext &context, const MatchContinuation &next) const override;
 
     [[nodiscard]] std::string to_string(int depth) const override;
+
+    void compile(ProgramBuilder &builder) const override;
+
+    void collect_literals(RequiredLiterals &literals) const override;
+
+    void collect_trigrams(TrigramQueryBuilder &query) const override;
 };
 
 // Token for matching one or more repetitions
@@ -158,9 +320,15 @@ class OneOrMore : public Token {
 public:
     explicit OneOrMore(const int index) : Token(index) {}
 
-    [[nodiscard]] MatchResult get_matches(const MatchContext &context) const override;
+    bool get_matches(const MatchContext &context, const MatchContinuation &next) const override;
 
     [[nodiscard]] std::string to_string(int depth) const override;
+
+    void compile(ProgramBuilder &builder) const override;
+
+    void collect_literals(RequiredLiterals &literals) const override;
+
+    void collect_trigrams(TrigramQueryBuilder &query) const override;
 };
 
 // Token for matching zero or one repetitions
@@ -168,17 +336,60 @@ class ZeroOrOne : public Token {
 public:
     explicit ZeroOrOne(const int index) : Token(index) {}
 
-    [[nodiscard]] MatchResult get_matches(const MatchContext &context) const override;
+    bool get_matches(const MatchContext &context, const MatchContinuation &next) const override;
 
     [[nodiscard]] std::string to_string(int depth) const override;
+
+    void compile(ProgramBuilder &builder) const override;
 };
 
-// Token for matching a wildcard
-class Wildcard : public Token {
+// Token for matching between min and max repetitions (max -1 for no limit), for '*' and '{n,m}'
+class Repeat : public Token {
+public:
+    static constexpr int MAX_COUNT = 1000; // largest count in '{n,m}', each repetition being compiled
+
+    int min;
+    int max;
+
+    explicit Repeat(const int index, const int min, const int max) : Token(index), min(min), max(max) {}
+
+    bool get_matches(const MatchContext &context, const MatchContinuation &next) const override;
+
+    [[nodiscard]] std::string to_string(int depth) const override;
+
+    void compile(ProgramBuilder &builder) const override;
+
+    void collect_literals(RequiredLiterals &literals) const override;
+
+    void collect_trigrams(TrigramQueryBuilder &query) const override;
+};
+
+// Token for atomic groups '(?>...)' and possessive repetitions: only the first way the child matches is
+// tried, whatever follows. The compiler also wraps repetitions whose giving back bytes could never help,
+// marking them implied: those don't change what matches, so every engine may ignore them.
+class Atomic : public Token {
 public:
-    explicit Wildcard(const int index) : Token(index) {}
+    bool implied;
+
+    explicit Atomic(const int index, const bool implied = false) : Token(index), implied(implied) {}
 
-    [[nodiscard]] MatchResult get_matches(const MatchContext &context) const override;
+    bool get_matches(const MatchContext &context, const MatchContinuation &next) const override;
+
+    [[nodiscard]] std::string to_string(int depth) const override;
+
+    void compile(ProgramBuilder &builder) const override;
+
+    void collect_literals(RequiredLiterals &literals) const override;
+
+    void collect_trigrams(TrigramQueryBuilder &query) const override;
+
+    void number(TokenNumbering &numbering) override;
+};
+
+// Token for matching a wildcard
+class Wildcard : public ByteClassToken {
+public:
+    explicit Wildcard(int index);
 
     [[nodiscard]] std::string to_string(int depth) const override;
 };
@@ -186,11 +397,20 @@ public:
 // Token for handling alternations (e.g. | in regex)
 class Alternation : public Token {
 public:
-    explicit Alternation(const int index) : Token(index) {}
+    bool capturing; // false for an alternation at the top level of the pattern
+    int group = -1; // capture group shared by all branches, -1 if not capturing
+
+    explicit Alternation(const int index, const bool capturing = true) : Token(index), capturing(capturing) {}
 
-    [[nodiscard]] MatchResult get_matches(const MatchContext &context) const override;
+    bool get_matches(const MatchContext &context, const MatchContinuation &next) const override;
 
     [[nodiscard]] std::string to_string(int depth) const override;
+
+    void compile(ProgramBuilder &builder) const override;
+
+    void collect_trigrams(TrigramQueryBuilder &query) const override;
+
+    void number(TokenNumbering &numbering) override;
 };
 
 #endif //TOKENS_HPP
@@ -0,0 +1,69 @@
+#ifndef TRIGRAMS_HPP
+#define TRIGRAMS_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Three consecutive bytes packed into 24 bits, the first one highest
+inline uint32_t pack_trigram(const char first, const char second, const char third) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(first)) << 16 |
+           static_cast<uint32_t>(static_cast<unsigned char>(second)) << 8 |
+           static_cast<uint32_t>(static_cast<unsigned char>(third));
+}
+
+// Boolean query over trigrams that every line matched by a pattern satisfies: a line can only match
+// if it contains the trigrams the query asks for. All is the query nothing can narrow down.
+class TrigramQuery {
+public:
+    enum class Kind {
+        All,     // any text may match
+        Trigram, // the text contains `trigram`
+        And,     // every child holds
+        Or,      // some child holds
+    };
+
+    Kind kind = Kind::All;
+    uint32_t trigram = 0;
+    std::vector<TrigramQuery> children;
+
+    // Every trigram of a literal string, or All if it is shorter than three bytes
+    static TrigramQuery of_literal(std::string_view literal);
+
+    // Conjunction of two queries, simplified
+    static TrigramQuery both(TrigramQuery left, TrigramQuery right);
+
+    // Disjunction of queries, simplified; All if any of them is All
+    static TrigramQuery any_of(std::vector<TrigramQuery> queries);
+
+    [[nodiscard]] bool is_all() const {
+        return kind == Kind::All;
+    }
+
+    // Readable form, for --debug
+    [[nodiscard]] std::string to_string() const;
+};
+
+// Collects the trigram query of a pattern from its token tree, in pattern order. Consecutive literals
+// form runs whose trigrams are all required; any other token ends the run.
+class TrigramQueryBuilder {
+private:
+    TrigramQuery query;
+    std::string run;
+
+public:
+    // Extend the current run with a byte every match contains at this point
+    void append(char literal);
+
+    // The next token may match anything: end the current run
+    void break_run();
+
+    // Every match also satisfies this query
+    void require(TrigramQuery required);
+
+    TrigramQuery finish();
+};
+
+#endif //TRIGRAMS_HPP
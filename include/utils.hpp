@@ -2,40 +2,136 @@
 #define UTILS_HPP
 
 #include <algorithm>
-#include <map>
-#include <stack>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
-namespace constants {
-    const std::string DIGITS = "0123456789";
-}
+#include "stats.hpp"
 
-struct Backreference {
-    int size;
-    std::vector<int> stack;
-    std::map<int, std::string> index_to_matched;
+// Span of the input as [begin, end) offsets
+using Span = std::pair<size_t, size_t>;
 
-    Backreference() : size(0) {}
+// Fixed-size capture nodes of one matching attempt, recycled through a free list. Reset it only
+// when no Backreference allocated from it is alive.
+class CaptureArena {
+private:
+    static constexpr size_t CHUNK_NODES = 256;
 
-    void init_index(){
-        stack.push_back(++size);
+    size_t node_size = 1; // reference count + 2 slots per group
+    std::vector<std::unique_ptr<size_t[]>> chunks;
+    size_t chunk_index = 0;
+    size_t chunk_used = 0;
+    std::vector<size_t *> free_nodes;
+
+public:
+    void reset(const int group_count) {
+        const size_t size = 1 + 2 * static_cast<size_t>(group_count);
+        if (size != node_size) {
+            chunks.clear();
+            node_size = size;
+        }
+        chunk_index = 0;
+        chunk_used = 0;
+        free_nodes.clear();
+    }
+
+    [[nodiscard]] size_t slot_count() const {
+        return node_size - 1;
+    }
+
+    // Bytes held by the chunks allocated so far
+    [[nodiscard]] size_t memory() const {
+        return chunks.size() * CHUNK_NODES * node_size * sizeof(size_t);
+    }
+
+    // Uninitialized node of node_size words
+    size_t *allocate() {
+        if (not free_nodes.empty()) {
+            size_t *node = free_nodes.back();
+            free_nodes.pop_back();
+            return node;
+        }
+
+        if (chunk_used == CHUNK_NODES) {
+            chunk_index++;
+            chunk_used = 0;
+        }
+        if (chunk_index == chunks.size()) {
+            chunks.push_back(std::make_unique<size_t[]>(CHUNK_NODES * node_size));
+        }
+
+        return chunks[chunk_index].get() + node_size * chunk_used++;
+    }
+
+    void release(size_t *node) {
+        free_nodes.push_back(node);
+    }
+};
+
+// Capture spans of a matching attempt, indexed by the group numbers assigned at compile time. Copies
+// share their slots until one of them records a capture (copy-on-write), so branching costs a reference
+// count increment instead of an allocation.
+class Backreference {
+private:
+    static constexpr size_t UNSET = static_cast<size_t>(-1);
+
+    CaptureArena *arena = nullptr;
+    size_t *node = nullptr; // [references, begin 0, end 0, begin 1, end 1, ...]
+
+    void drop() {
+        if (node != nullptr and --node[0] == 0) {
+            arena->release(node);
+        }
+    }
+
+public:
+    explicit Backreference(CaptureArena &arena) : arena(&arena), node(arena.allocate()) {
+        node[0] = 1;
+        std::fill(node + 1, node + 1 + arena.slot_count(), UNSET);
+    }
+
+    Backreference(const Backreference &other) : arena(other.arena), node(other.node) {
+        if (node != nullptr) {
+            node[0]++;
+        }
+    }
+
+    Backreference(Backreference &&other) noexcept : arena(other.arena), node(std::exchange(other.node, nullptr)) {}
+
+    Backreference &operator=(Backreference other) noexcept {
+        std::swap(arena, other.arena);
+        std::swap(node, other.node);
+        return *this;
     }
 
-    void add_match(const std::string &matched) {
-        index_to_matched[stack.back()] = matched;
-        stack.pop_back();
+    ~Backreference() {
+        drop();
     }
 
-    std::string get_matched_at(const int index) {
-        if (not index_to_matched.contains(index)) {
-            return "";
+    // Record the span of a group, copying the slots first if they are shared
+    void add_match(const int group, const size_t begin, const size_t end) {
+        if (node[0] > 1) {
+            count_stat(StatCounter::BackreferenceCopies);
+            size_t *copy = arena->allocate();
+            std::copy(node, node + 1 + arena->slot_count(), copy);
+            copy[0] = 1;
+            node[0]--;
+            node = copy;
         }
 
-        return index_to_matched[index];
+        node[1 + 2 * group] = begin;
+        node[2 + 2 * group] = end;
     }
 
+    // Span captured by the group, empty if it did not take part in the match
+    [[nodiscard]] Span get_matched_at(const int group) const {
+        if (node == nullptr or 2 * static_cast<size_t>(group) >= arena->slot_count() or node[1 + 2 * group] == UNSET) {
+            return {0, 0};
+        }
+
+        return {node[1 + 2 * group], node[2 + 2 * group]};
+    }
 };
 
 #endif //UTILS_HPP
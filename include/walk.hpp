@@ -0,0 +1,21 @@
+#ifndef WALK_HPP
+#define WALK_HPP
+
+#include <functional>
+#include <string>
+
+#include "ThreadPool.hpp"
+
+
+// What to do with the entries found by walk_directory. Both are called from the pool's workers.
+struct WalkCallbacks {
+    std::function<void(std::string path)> on_file;       // a regular file
+    std::function<void(const std::string &path)> on_error; // a directory that couldn't be read, errno set
+};
+
+// Walks the directory tree as tasks of the pool, one per directory, so subtrees are listed
+// concurrently. Symbolic links found in the tree are not followed. The callbacks must stay alive
+// until the pool has finished.
+void walk_directory(ThreadPool &pool, const std::string &path, const WalkCallbacks &callbacks);
+
+#endif //WALK_HPP
@@ -0,0 +1,77 @@
+#include "AhoCorasick.hpp"
+
+#include <queue>
+
+
+AhoCorasick::AhoCorasick(const std::vector<std::string> &key_list) {
+    // 1. Byte classes: class 0 stands for every byte no key contains. Should the keys hold all 256 bytes,
+    //    the last one found keeps class 0, left to it alone, so there are never more than 256 classes.
+    for (const auto &key: key_list) {
+        for (const char byte: key) {
+            auto &byte_class = byte_classes[static_cast<unsigned char>(byte)];
+            if (byte_class == 0 and class_count < byte_classes.size()) {
+                byte_class = static_cast<uint8_t>(class_count++);
+            }
+        }
+    }
+    static_assert(std::tuple_size_v<decltype(byte_classes)> - 1 <= UINT8_MAX, "class ids must fit in a byte");
+
+    constexpr uint32_t NONE = UINT32_MAX;
+    auto add_state = [&] {
+        transitions.resize(transitions.size() + class_count, NONE);
+        keys.push_back(-1);
+        output_links.push_back(-1);
+        return static_cast<uint32_t>(keys.size() - 1);
+    };
+
+    // 2. Trie of the keys.
+    add_state();
+    for (size_t id = 0; id < key_list.size(); id++) {
+        uint32_t state = START;
+        for (const char byte: key_list[id]) {
+            const size_t slot = state * class_count + byte_classes[static_cast<unsigned char>(byte)];
+            if (transitions[slot] == NONE) {
+                const uint32_t child = add_state();
+                transitions[slot] = child;
+            }
+            state = transitions[slot];
+        }
+        if (keys[state] < 0) {
+            keys[state] = static_cast<int32_t>(id);
+        }
+    }
+
+    // 3. Breadth first, so the failure state of a node (always shallower) is complete before the node:
+    // missing transitions are taken from the failure state, which turns the trie into a DFA.
+    std::vector<uint32_t> failure(keys.size(), START);
+    std::queue<uint32_t> queue;
+
+    for (size_t byte_class = 0; byte_class < class_count; byte_class++) {
+        uint32_t &target = transitions[byte_class];
+        if (target == NONE) {
+            target = START;
+        } else {
+            queue.push(target);
+        }
+    }
+
+    while (not queue.empty()) {
+        const uint32_t state = queue.front();
+        queue.pop();
+
+        const uint32_t fallback = failure[state];
+        output_links[state] = keys[fallback] >= 0 ? static_cast<int32_t>(fallback) : output_links[fallback];
+
+        for (size_t byte_class = 0; byte_class < class_count; byte_class++) {
+            uint32_t &target = transitions[state * class_count + byte_class];
+            const uint32_t inherited = transitions[fallback * class_count + byte_class];
+
+            if (target == NONE) {
+                target = inherited;
+            } else {
+                failure[target] = inherited;
+                queue.push(target);
+            }
+        }
+    }
+}
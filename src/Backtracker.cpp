@@ -0,0 +1,259 @@
+#include "Backtracker.hpp"
+
+#include <algorithm>
+
+#include "stats.hpp"
+
+
+namespace {
+    // Pending alternative: resume at pc and position, undo a Save on the way back, or resume at pc from
+    // each position of a repeated byte run, from value down to run_begin. An Atomic frame marks where an
+    // atomic group began, value being its AtomicBegin's argument; backtracking past it just drops it.
+    struct Frame {
+        enum class Kind : uint8_t {
+            Resume,
+            Restore,
+            Run,
+            Atomic,
+        };
+
+        Kind kind;
+        int pc_or_slot;
+        size_t value;
+        size_t run_begin = 0;
+    };
+
+    // Working memory reused by every search on the same thread
+    struct Scratch {
+        std::vector<Frame> stack;
+        std::vector<size_t> slots;
+        MatchMemo visited;
+    };
+
+    thread_local Scratch scratch;
+
+    bool consumes(const Program &program, const Instruction &instruction, const unsigned char byte) {
+        switch (instruction.opcode) {
+            case Opcode::Char:
+                return static_cast<unsigned char>(instruction.literal) == byte;
+            case Opcode::Class:
+                return program.classes[instruction.argument][byte];
+            case Opcode::Any:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // End of the run of bytes consumed by the instruction from position on
+    size_t run_end(const Program &program, const Instruction &instruction, std::string_view input, size_t position) {
+        switch (instruction.opcode) {
+            case Opcode::Char:
+                while (position < input.size() and input[position] == instruction.literal) {
+                    position++;
+                }
+                return position;
+            case Opcode::Class:
+                return program.classes[instruction.argument].span(input, position, true);
+            default:
+                return input.size();
+        }
+    }
+
+    // Whether pc consumes one byte and is followed by the Split of a greedy repetition of it
+    bool is_byte_loop(const std::vector<Instruction> &instructions, const int pc) {
+        const Instruction &next = instructions[pc + 1];
+        return next.opcode == Opcode::Split and next.argument == pc and next.alternative == pc + 2;
+    }
+}
+
+
+Backtracker::Result Backtracker::search(std::string_view input, std::vector<size_t> *captures,
+                                        const size_t from) const {
+    const auto &instructions = program.instructions;
+    auto &[stack, slots, visited] = scratch;
+
+    // Without backreferences the outcome from a (pc, position) pair doesn't depend on the captures,
+    // so a pair that failed once fails for every later start position too. Inside an atomic group of
+    // the pattern it also depends on the alternatives the group will drop, so those pairs aren't kept.
+    const bool use_visited = memoize and not program.has_backrefs
+                             and visited.reset(instructions.size(), input.size(), memory_limit);
+
+    // A group's begin is kept aside until the group closes, past the loop slots, so that a backreference
+    // inside the group still sees the span of its previous iteration.
+    const int pending_begins = program.slot_count() + program.loop_count;
+    slots.assign(pending_begins + program.group_count, std::string_view::npos);
+
+    const size_t max_frames = memory_limit / sizeof(Frame);
+
+    // Kept in locals so the loop doesn't touch thread-local storage
+    uint64_t steps = 0;
+    uint64_t discarded = 0; // dead unless built with stats, like peak_stack
+    size_t peak_stack = 0;
+    size_t open_atomics = 0; // Atomic frames of groups written in the pattern on the stack
+    auto report = [&] {
+        count_stat(StatCounter::BacktrackSteps, steps);
+        count_stat(StatCounter::AtomicDiscards, discarded);
+        raise_stat(StatGauge::BacktrackStack, peak_stack);
+    };
+
+    const size_t last_start = program.anchored ? 0 : input.size();
+    for (size_t start = from; start <= last_start; start++) {
+        count_stat(StatCounter::StartPositions);
+        stack.clear();
+        stack.push_back({Frame::Kind::Resume, 0, start});
+        open_atomics = 0;
+
+        while (not stack.empty()) {
+            peak_stack = std::max(peak_stack, stack.size());
+            const Frame frame = stack.back();
+            stack.pop_back();
+
+            if (frame.kind == Frame::Kind::Restore) {
+                slots[frame.pc_or_slot] = frame.value;
+                continue;
+            }
+            if (frame.kind == Frame::Kind::Atomic) {
+                open_atomics -= frame.value;
+                continue;
+            }
+            if (frame.kind == Frame::Kind::Run and frame.value > frame.run_begin) {
+                stack.push_back({Frame::Kind::Run, frame.pc_or_slot, frame.value - 1, frame.run_begin});
+            }
+
+            int pc = frame.pc_or_slot;
+            size_t position = frame.value;
+
+            // Follow one path until it fails; alternatives wait on the stack.
+            bool alive = true;
+            while (alive) {
+                if (use_visited and open_atomics == 0) {
+                    if (visited.failed(pc, position)) {
+                        break;
+                    }
+                    visited.mark_failed(pc, position);
+                }
+
+                if (++steps > step_budget or stack.size() > max_frames) {
+                    report();
+                    return Result::GaveUp;
+                }
+
+                const Instruction &instruction = instructions[pc];
+                switch (instruction.opcode) {
+                    case Opcode::Char:
+                    case Opcode::Class:
+                    case Opcode::Any:
+                        if (is_byte_loop(instructions, pc)) {
+                            // Consume the whole run at once (with the SIMD class kernels) and leave a
+                            // single frame to give back one byte at a time.
+                            const size_t end = run_end(program, instruction, input, position);
+                            if (end == position) {
+                                alive = false;
+                                break;
+                            }
+                            if (use_visited and open_atomics == 0) {
+                                for (size_t inner = position + 1; inner < end; inner++) {
+                                    visited.mark_failed(pc, inner);
+                                }
+                            }
+                            if (end - 1 > position) {
+                                stack.push_back({Frame::Kind::Run, pc + 2, end - 1, position + 1});
+                            }
+                            pc += 2;
+                            position = end;
+                            break;
+                        }
+
+                        alive = position < input.size()
+                                and consumes(program, instruction, static_cast<unsigned char>(input[position]));
+                        pc++;
+                        position++;
+                        break;
+                    case Opcode::Split:
+                        stack.push_back({Frame::Kind::Resume, instruction.alternative, position});
+                        pc = instruction.argument;
+                        break;
+                    case Opcode::Jump:
+                        pc = instruction.argument;
+                        break;
+                    case Opcode::Loop:
+                        // An empty iteration would come back here forever: it ends the loop instead.
+                        if (position != slots[instruction.alternative]) {
+                            stack.push_back({Frame::Kind::Resume, pc + 1, position});
+                            pc = instruction.argument;
+                        } else {
+                            pc++;
+                        }
+                        break;
+                    case Opcode::AtomicBegin:
+                        stack.push_back({Frame::Kind::Atomic, 0, static_cast<size_t>(instruction.argument)});
+                        open_atomics += instruction.argument;
+                        pc++;
+                        break;
+                    case Opcode::AtomicEnd: {
+                        // Commit to the way the group matched: the alternatives it left are dropped, while
+                        // the saves to undo stay in order.
+                        auto marker = stack.end() - 1;
+                        while (marker->kind != Frame::Kind::Atomic) {
+                            marker--;
+                        }
+                        open_atomics -= marker->value;
+                        const auto kept = std::remove_if(marker, stack.end(), [](const Frame &pending) {
+                            return pending.kind != Frame::Kind::Restore;
+                        });
+                        discarded += stack.end() - kept - 1;
+                        stack.erase(kept, stack.end());
+                        pc++;
+                        break;
+                    }
+                    case Opcode::Save: {
+                        int slot = instruction.argument;
+                        if (slot < program.slot_count()) {
+                            if (slot % 2 == 0) {
+                                slot = pending_begins + slot / 2;
+                            } else {
+                                stack.push_back({Frame::Kind::Restore, slot - 1, slots[slot - 1]});
+                                slots[slot - 1] = slots[pending_begins + slot / 2];
+                            }
+                        }
+                        stack.push_back({Frame::Kind::Restore, slot, slots[slot]});
+                        slots[slot] = position;
+                        pc++;
+                        break;
+                    }
+                    case Opcode::AssertBegin:
+                        alive = position == 0;
+                        pc++;
+                        break;
+                    case Opcode::AssertEnd:
+                        alive = position == input.size();
+                        pc++;
+                        break;
+                    case Opcode::Backref: {
+                        // A group that did not take part, or has not closed yet, matches the empty string.
+                        const size_t begin = slots[2 * instruction.argument];
+                        const size_t end = slots[2 * instruction.argument + 1];
+                        const std::string_view captured = (begin == std::string_view::npos or end == std::string_view::npos
+                                                           or begin > end)
+                                                          ? std::string_view() : input.substr(begin, end - begin);
+
+                        alive = input.substr(position).starts_with(captured);
+                        pc++;
+                        position += captured.size();
+                        break;
+                    }
+                    case Opcode::Match:
+                        if (captures != nullptr) {
+                            captures->assign(slots.begin(), slots.begin() + program.slot_count());
+                        }
+                        report();
+                        return Result::Match;
+                }
+            }
+        }
+    }
+
+    report();
+    return Result::NoMatch;
+}
@@ -0,0 +1,159 @@
+#include "ByteClass.hpp"
+
+#include <bit>
+
+#if defined(__GNUC__) and (defined(__x86_64__) or defined(__i386__))
+#define BYTE_CLASS_X86
+#include <immintrin.h>
+#endif
+
+
+namespace {
+    using SpanKernel = size_t (*)(const ByteClass &bytes, const char *data, size_t size, size_t from, bool inside);
+
+    size_t span_scalar(const ByteClass &bytes, const char *data, const size_t size, size_t from, const bool inside) {
+        while (from < size and bytes.contains(static_cast<unsigned char>(data[from])) == inside) {
+            from++;
+        }
+        return from;
+    }
+
+#ifdef BYTE_CLASS_X86
+    // Membership of 16 bytes: pick the row of each low nibble in the table of its half, then test
+    // the bit of its high nibble. Returns 0xff for members and 0 for the others.
+    __attribute__((target("sse4.2"), always_inline))
+    inline __m128i members_sse(const __m128i chunk, const __m128i low_table, const __m128i high_table,
+                               const __m128i bit_table) {
+        const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+        const __m128i low_nibbles = _mm_and_si128(chunk, nibble_mask);
+        const __m128i high_nibbles = _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble_mask);
+
+        // blendv selects by the top bit of each byte, which tells the two halves of the byte range apart.
+        const __m128i rows = _mm_blendv_epi8(_mm_shuffle_epi8(low_table, low_nibbles),
+                                             _mm_shuffle_epi8(high_table, low_nibbles), chunk);
+        const __m128i bits = _mm_shuffle_epi8(bit_table, high_nibbles);
+        return _mm_cmpeq_epi8(_mm_and_si128(rows, bits), bits);
+    }
+
+    // Scans 16 bytes at a time, up to limit chunks; returns the stop position, or size if there is none
+    // in the chunks scanned, with from left at the first byte not scanned.
+    __attribute__((target("sse4.2"), always_inline))
+    inline size_t span_chunks_sse(const ByteClass &bytes, const char *data, const size_t size, size_t &from,
+                                  const bool inside, size_t limit) {
+        const __m128i low_table = _mm_load_si128(reinterpret_cast<const __m128i *>(bytes.low_table()));
+        const __m128i high_table = _mm_load_si128(reinterpret_cast<const __m128i *>(bytes.high_table()));
+        const __m128i bit_table = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+        const unsigned flip = inside ? 0xffff : 0;
+
+        while (limit-- > 0 and from + 16 <= size) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from));
+            const unsigned stops = static_cast<unsigned>(_mm_movemask_epi8(
+                    members_sse(chunk, low_table, high_table, bit_table))) ^ flip;
+            if (stops != 0) {
+                return from + std::countr_zero(stops);
+            }
+            from += 16;
+        }
+
+        return size;
+    }
+
+    __attribute__((target("sse4.2")))
+    size_t span_sse42(const ByteClass &bytes, const char *data, const size_t size, size_t from, const bool inside) {
+        if (const size_t stop = span_chunks_sse(bytes, data, size, from, inside, SIZE_MAX); stop != size) {
+            return stop;
+        }
+        return span_scalar(bytes, data, size, from, inside);
+    }
+
+    __attribute__((target("avx2")))
+    size_t span_avx2(const ByteClass &bytes, const char *data, const size_t size, size_t from, const bool inside) {
+        // Most runs are short: settle the first 16 bytes before paying for the 256-bit setup.
+        if (const size_t stop = span_chunks_sse(bytes, data, size, from, inside, 1); stop != size) {
+            return stop;
+        }
+
+        // vpshufb looks up within each 128-bit lane, so both lanes get a copy of the tables.
+        const __m256i low_table = _mm256_broadcastsi128_si256(
+                _mm_load_si128(reinterpret_cast<const __m128i *>(bytes.low_table())));
+        const __m256i high_table = _mm256_broadcastsi128_si256(
+                _mm_load_si128(reinterpret_cast<const __m128i *>(bytes.high_table())));
+        const __m256i bit_table = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                                   1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+        const __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+        const uint32_t flip = inside ? 0xffffffff : 0;
+
+        while (from + 32 <= size) {
+            const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + from));
+            const __m256i low_nibbles = _mm256_and_si256(chunk, nibble_mask);
+            const __m256i high_nibbles = _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble_mask);
+
+            const __m256i rows = _mm256_blendv_epi8(_mm256_shuffle_epi8(low_table, low_nibbles),
+                                                    _mm256_shuffle_epi8(high_table, low_nibbles), chunk);
+            const __m256i bits = _mm256_shuffle_epi8(bit_table, high_nibbles);
+            const __m256i members = _mm256_cmpeq_epi8(_mm256_and_si256(rows, bits), bits);
+
+            const uint32_t stops = static_cast<uint32_t>(_mm256_movemask_epi8(members)) ^ flip;
+            if (stops != 0) {
+                return from + std::countr_zero(stops);
+            }
+            from += 32;
+        }
+
+        if (const size_t stop = span_chunks_sse(bytes, data, size, from, inside, 1); stop != size) {
+            return stop;
+        }
+        return span_scalar(bytes, data, size, from, inside);
+    }
+#endif
+
+    SpanKernel select_kernel() {
+#ifdef BYTE_CLASS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return span_avx2;
+        }
+        if (__builtin_cpu_supports("sse4.2")) {
+            return span_sse42;
+        }
+#endif
+        return span_scalar;
+    }
+}
+
+
+void ByteClass::insert(const unsigned char byte) {
+    words[byte >> 6] |= uint64_t(1) << (byte & 63);
+
+    auto &rows = byte < 0x80 ? low_rows : high_rows;
+    rows[byte & 0x0f] |= static_cast<uint8_t>(1 << ((byte >> 4) & 7));
+}
+
+void ByteClass::insert_range(const unsigned char first, const unsigned char last) {
+    for (int byte = first; byte <= last; byte++) {
+        insert(static_cast<unsigned char>(byte));
+    }
+}
+
+void ByteClass::invert() {
+    for (auto &word: words) {
+        word = ~word;
+    }
+    for (size_t nibble = 0; nibble < 16; nibble++) {
+        low_rows[nibble] = ~low_rows[nibble];
+        high_rows[nibble] = ~high_rows[nibble];
+    }
+}
+
+int ByteClass::count() const {
+    int total = 0;
+    for (const auto word: words) {
+        total += std::popcount(word);
+    }
+    return total;
+}
+
+size_t ByteClass::span(std::string_view input, const size_t from, const bool inside) const {
+    static const SpanKernel kernel = select_kernel();
+    return kernel(*this, input.data(), input.size(), from, inside);
+}
@@ -0,0 +1,208 @@
+#include "CompiledPattern.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <ranges>
+#include <stdexcept>
+
+#include "Backtracker.hpp"
+#include "PikeVM.hpp"
+#include "stats.hpp"
+#include "tokenizer.hpp"
+
+
+// A configured limit, where 0 means none
+static size_t limit_or_max(const size_t limit) {
+    return limit != 0 ? limit : std::numeric_limits<size_t>::max();
+}
+
+
+CompiledPattern::CompiledPattern(const std::string &pattern, const PatternConfig &config)
+        : root(tokenize(pattern)), program(compile_program(*root)), config(config),
+          dfa_cache_id(LazyDFA::new_cache_id()),
+          memo_slot_count(std::static_pointer_cast<const Level>(root)->memo_slot_end()) {
+    // Only the backtracker and the tree walk handle backreferences and atomic groups.
+    if ((program.has_backrefs or program.has_atomic) and config.engine != Engine::Tree) {
+        this->config.engine = Engine::Backtrack;
+    } else if (config.engine == Engine::Auto) {
+        this->config.engine = Engine::DFA;
+    }
+
+    if (config.prefilter) {
+        RequiredLiterals literals;
+        root->collect_literals(literals);
+
+        for (auto &literal: literals.finish()) {
+            required_literals.emplace_back(std::move(literal));
+        }
+        literal_only = literals.is_exact();
+    }
+}
+
+std::optional<bool> CompiledPattern::walk_tree(std::string_view input) const {
+    // Capture nodes are recycled across lines; none is alive between two calls.
+    thread_local CaptureArena arena;
+    arena.reset(program.group_count);
+
+    // One memo serves every start position of the line; captures would change outcomes, so patterns
+    // with backreferences can't use it.
+    const size_t memory_limit = limit_or_max(config.match_memory_limit);
+    thread_local MatchMemo memo;
+    MatchMemo *line_memo = nullptr;
+    if (config.memoize and not program.has_backrefs and memo.reset(memo_slot_count, input.size(), memory_limit)) {
+        line_memo = &memo;
+    }
+
+    WalkBudget budget(limit_or_max(config.step_budget), memory_limit, arena);
+    auto positions = std::views::iota(0, (int)input.size() + 1);
+
+    try {
+        return std::ranges::any_of(positions, [&](size_t position) {
+            count_stat(StatCounter::StartPositions);
+            const Backreference backreference(arena);
+            return root->get_matches(MatchContext(input, position, backreference, line_memo, &budget),
+                                     [](const Backreference &, size_t) {
+                                         return true;
+                                     });
+        });
+    } catch (const WalkBudget::Exceeded &) {
+        return std::nullopt;
+    }
+}
+
+bool CompiledPattern::match_over_budget(std::string_view input) const {
+    // Without backreferences nor atomic groups the Pike VM gives the same answer in linear time.
+    if (not program.has_backrefs and not program.has_atomic) {
+        count_stat(StatCounter::BudgetFallbacks);
+        return PikeVM(program).search(input, nullptr);
+    }
+
+    give_up(input);
+    return false;
+}
+
+void CompiledPattern::give_up(std::string_view input) const {
+    count_stat(StatCounter::BudgetExceeded);
+    if (config.on_budget_exceeded) {
+        config.on_budget_exceeded(input);
+    }
+}
+
+bool CompiledPattern::match(std::string_view input) const {
+    std::optional<LazyDFA> dfa;
+    return match(input, dfa);
+}
+
+bool CompiledPattern::match(std::string_view input, std::optional<LazyDFA> &dfa) const {
+    return match_from_literal(input, 0, dfa);
+}
+
+bool CompiledPattern::match_prefiltered(std::string_view input, std::optional<LazyDFA> &dfa) const {
+    return match_from_literal(input, 1, dfa);
+}
+
+bool CompiledPattern::match_from_literal(std::string_view input, const size_t first_literal,
+                                         std::optional<LazyDFA> &dfa) const {
+    for (size_t index = first_literal; index < required_literals.size(); index++) {
+        if (required_literals[index].find(input) == std::string_view::npos) {
+            return false;
+        }
+    }
+
+    if (literal_only) {
+        return true;
+    }
+
+    count_stat(StatCounter::EngineCalls);
+
+    switch (config.engine) {
+        case Engine::DFA:
+            if (not dfa) {
+                dfa.emplace(program, dfa_cache_id, config.dfa_memory_limit);
+            }
+            if (const auto result = dfa->search(input); result != LazyDFA::Result::GaveUp) {
+                return result == LazyDFA::Result::Match;
+            }
+            count_stat(StatCounter::DfaFallbacks);
+            [[fallthrough]];
+        case Engine::PikeVM:
+            return PikeVM(program).search(input, nullptr);
+        case Engine::Backtrack:
+            if (const auto result = Backtracker(program, config.memoize, limit_or_max(config.step_budget),
+                                               limit_or_max(config.match_memory_limit)).search(input, nullptr);
+                    result != Backtracker::Result::GaveUp) {
+                return result == Backtracker::Result::Match;
+            }
+            return match_over_budget(input);
+        default:
+            if (const std::optional<bool> matched = walk_tree(input)) {
+                return *matched;
+            }
+            return match_over_budget(input);
+    }
+}
+
+size_t CompiledPattern::match_lines(const std::span<const std::string_view> lines,
+                                    const std::span<uint64_t> matches) const {
+    if (matches.size() < bitmap_words(lines.size())) {
+        throw std::invalid_argument("match_lines: bitmap too small for the lines");
+    }
+    std::fill_n(matches.begin(), bitmap_words(lines.size()), 0);
+
+    std::optional<LazyDFA> dfa;
+    size_t count = 0;
+    for (size_t index = 0; index < lines.size(); index++) {
+        if (match(lines[index], dfa)) {
+            matches[index / 64] |= uint64_t{1} << (index % 64);
+            count++;
+        }
+    }
+    return count;
+}
+
+std::optional<Span> CompiledPattern::find(std::string_view input, const size_t from) const {
+    if (literal_only) {
+        const size_t begin = required_literals.front().find(input, from);
+        if (begin == std::string_view::npos) {
+            return std::nullopt;
+        }
+        return Span(begin, begin + required_literals.front().literal().size());
+    }
+
+    for (const auto &literal: required_literals) {
+        if (literal.find(input, from) == std::string_view::npos) {
+            return std::nullopt;
+        }
+    }
+
+    thread_local std::vector<size_t> captures;
+    bool found;
+
+    if (config.engine == Engine::Backtrack or config.engine == Engine::Tree) {
+        const auto result = Backtracker(program, config.memoize, limit_or_max(config.step_budget),
+                                        limit_or_max(config.match_memory_limit)).search(input, &captures, from);
+        if (result == Backtracker::Result::GaveUp and (program.has_backrefs or program.has_atomic)) {
+            give_up(input);
+            return std::nullopt;
+        }
+        found = result == Backtracker::Result::GaveUp ? PikeVM(program).search(input, &captures, from)
+                                                      : result == Backtracker::Result::Match;
+    } else {
+        found = PikeVM(program).search(input, &captures, from);
+    }
+
+    if (not found) {
+        return std::nullopt;
+    }
+    return Span(captures[0], captures[1]);
+}
+
+TrigramQuery CompiledPattern::trigram_query() const {
+    TrigramQueryBuilder query;
+    root->collect_trigrams(query);
+    return query.finish();
+}
+
+std::string CompiledPattern::to_string() const {
+    return root->to_string(0) + program.to_string();
+}
@@ -0,0 +1,325 @@
+#include "LazyDFA.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "stats.hpp"
+
+
+namespace {
+    constexpr int32_t UNKNOWN = -1;
+    constexpr size_t FULL_CACHES_PER_THREAD = 8; // memory of the caches of a thread, in full caches
+    constexpr size_t MIN_FLUSHES = 3;          // flushes tolerated before judging the cache efficiency
+    constexpr size_t MIN_BYTES_PER_STATE = 10; // below this the DFA is slower than the Pike VM
+
+    struct State {
+        std::vector<int> pcs; // consuming instructions, Match and pending end assertions, sorted
+        bool is_match;
+        bool match_at_end;
+    };
+
+    struct PcsHash {
+        size_t operator()(const std::vector<int> &pcs) const {
+            size_t hash = pcs.size();
+            for (const int pc: pcs) {
+                hash ^= static_cast<size_t>(pc) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+            }
+            return hash;
+        }
+    };
+
+    // Computes NFA state sets by following epsilon transitions
+    class Closure {
+    private:
+        std::vector<uint32_t> seen;
+        uint32_t generation = 0;
+        std::vector<int> stack;
+
+    public:
+        std::vector<int> pcs;
+
+        void clear(const Program &program) {
+            seen.resize(program.instructions.size(), 0);
+            pcs.clear();
+            generation++;
+        }
+
+        // Adds every instruction reachable from pc without consuming input
+        void follow(const Program &program, const int start_pc, const bool at_begin, const bool at_end) {
+            stack.push_back(start_pc);
+
+            while (not stack.empty()) {
+                const int pc = stack.back();
+                stack.pop_back();
+
+                if (seen[pc] == generation) {
+                    continue;
+                }
+                seen[pc] = generation;
+
+                const Instruction &instruction = program.instructions[pc];
+                switch (instruction.opcode) {
+                    case Opcode::Jump:
+                        stack.push_back(instruction.argument);
+                        break;
+                    case Opcode::Split:
+                        stack.push_back(instruction.alternative);
+                        stack.push_back(instruction.argument);
+                        break;
+                    case Opcode::Loop:
+                        stack.push_back(pc + 1);
+                        stack.push_back(instruction.argument);
+                        break;
+                    case Opcode::Save:
+                    case Opcode::AtomicBegin: // only implied atomic groups, which don't change the matches
+                    case Opcode::AtomicEnd:
+                        stack.push_back(pc + 1);
+                        break;
+                    case Opcode::AssertBegin:
+                        if (at_begin) {
+                            stack.push_back(pc + 1);
+                        }
+                        break;
+                    case Opcode::AssertEnd:
+                        if (at_end) {
+                            stack.push_back(pc + 1);
+                        } else {
+                            pcs.push_back(pc);
+                        }
+                        break;
+                    default:
+                        pcs.push_back(pc);
+                        break;
+                }
+            }
+        }
+
+        [[nodiscard]] bool has_match(const Program &program) const {
+            return std::ranges::any_of(pcs, [&](const int pc) {
+                return program.instructions[pc].opcode == Opcode::Match;
+            });
+        }
+
+        // Whether the given state set matches if the input ends here
+        bool matches_at_end(const Program &program, const std::vector<int> &state_pcs, const bool at_begin) {
+            clear(program);
+            for (const int pc: state_pcs) {
+                const Opcode opcode = program.instructions[pc].opcode;
+                if (opcode == Opcode::Match) {
+                    return true;
+                }
+                if (opcode == Opcode::AssertEnd) {
+                    follow(program, pc + 1, at_begin, true);
+                }
+            }
+            return has_match(program);
+        }
+    };
+
+    size_t state_cost(const std::vector<int> &pcs) {
+        // The pcs are stored twice, in the state and as the index key.
+        return sizeof(State) + 2 * pcs.size() * sizeof(int) + 256 * sizeof(int32_t) + 64;
+    }
+
+    bool consumes(const Program &program, const Instruction &instruction, const unsigned char byte) {
+        switch (instruction.opcode) {
+            case Opcode::Char:
+                return static_cast<unsigned char>(instruction.literal) == byte;
+            case Opcode::Class:
+                return program.classes[instruction.argument][byte];
+            case Opcode::Any:
+                return true;
+            default:
+                return false;
+        }
+    }
+}
+
+
+// States and transitions of one program, owned by a single thread
+struct LazyDFA::Cache {
+    uint64_t id;
+    std::vector<State> states;
+    std::vector<int32_t> transitions; // 256 entries per state
+    std::unordered_map<std::vector<int>, int32_t, PcsHash> index;
+    size_t memory = 0;
+    size_t overhead;                 // memory of an empty cache
+    size_t *thread_memory = nullptr; // memory of every cache of the thread, or nullptr once evicted
+    int32_t start = UNKNOWN;
+    Closure closure;
+
+    Cache(const uint64_t id, const size_t overhead) : id(id), overhead(overhead) {}
+
+    void add_memory(const size_t cost) {
+        memory += cost;
+        if (thread_memory != nullptr) {
+            *thread_memory += cost;
+        }
+    }
+
+    void clear() {
+        if (thread_memory != nullptr) {
+            *thread_memory -= memory;
+        }
+        states.clear();
+        transitions.clear();
+        index.clear();
+        memory = 0;
+        start = UNKNOWN;
+    }
+};
+
+std::shared_ptr<LazyDFA::Cache> LazyDFA::cache_for(const Program &program, const uint64_t id,
+                                                   const size_t memory_limit) {
+    // Caches of this thread, most recently used first, with the memory they use together
+    struct ThreadCaches {
+        std::list<std::shared_ptr<Cache>> caches;
+        std::unordered_map<uint64_t, std::list<std::shared_ptr<Cache>>::iterator> by_id;
+        size_t memory = 0;
+
+        ~ThreadCaches() {
+            for (const auto &cache: caches) {
+                cache->thread_memory = nullptr;
+            }
+        }
+    };
+    thread_local ThreadCaches thread;
+
+    if (const auto found = thread.by_id.find(id); found != thread.by_id.end()) {
+        thread.caches.splice(thread.caches.begin(), thread.caches, found->second);
+    } else {
+        const size_t overhead = sizeof(Cache) + program.instructions.size() * sizeof(uint32_t);
+        auto cache = std::make_shared<Cache>(id, overhead);
+        cache->thread_memory = &thread.memory;
+        thread.memory += overhead;
+        thread.caches.push_front(std::move(cache));
+        thread.by_id.emplace(id, thread.caches.begin());
+    }
+
+    // Evict the least recently used caches of other programs while the thread holds too much. Caches
+    // are charged for what they use, so many small DFAs stay warm side by side.
+    while (thread.memory > FULL_CACHES_PER_THREAD * memory_limit and thread.caches.size() > 1) {
+        Cache &evicted = *thread.caches.back();
+        thread.memory -= evicted.memory + evicted.overhead;
+        evicted.thread_memory = nullptr;
+        thread.by_id.erase(evicted.id);
+        thread.caches.pop_back();
+    }
+
+    return thread.caches.front();
+}
+
+
+uint64_t LazyDFA::new_cache_id() {
+    static std::atomic<uint64_t> next_id = 0;
+    return next_id++;
+}
+
+LazyDFA::Result LazyDFA::search(std::string_view input) const {
+    Cache &cache = *this->cache;
+    Closure &closure = cache.closure;
+
+    // Adds a state, or returns UNKNOWN if the cache has no room left for it.
+    auto add_state = [&](std::vector<int> pcs) -> int32_t {
+        if (const auto found = cache.index.find(pcs); found != cache.index.end()) {
+            return found->second;
+        }
+
+        const size_t cost = state_cost(pcs);
+        if (cache.memory + cost > memory_limit) {
+            return UNKNOWN;
+        }
+
+        const auto id = static_cast<int32_t>(cache.states.size());
+        const bool is_match = closure.has_match(program);
+        const bool match_at_end = closure.matches_at_end(program, pcs, false);
+
+        count_stat(StatCounter::DfaStates);
+        cache.add_memory(cost);
+        cache.index.emplace(pcs, id);
+        cache.states.push_back({std::move(pcs), is_match, match_at_end});
+        cache.transitions.resize(cache.transitions.size() + 256, UNKNOWN);
+        return id;
+    };
+
+    // 1. Position 0 is the only one where ^ holds, so an empty input is answered directly. For any
+    //    other input the start state is the same, so it is built once per cache.
+    if (input.empty()) {
+        closure.clear(program);
+        closure.follow(program, 0, true, true);
+        return closure.has_match(program) ? Result::Match : Result::NoMatch;
+    }
+
+    if (cache.start == UNKNOWN) {
+        closure.clear(program);
+        closure.follow(program, 0, true, false);
+        if (closure.has_match(program)) {
+            return Result::Match;
+        }
+
+        std::ranges::sort(closure.pcs);
+        cache.start = add_state(closure.pcs);
+        if (cache.start == UNKNOWN) {
+            return Result::GaveUp;
+        }
+    }
+
+    // 2. Follow cached transitions, building missing states on the way.
+    int32_t state = cache.start;
+    size_t flushes = 0;
+    size_t states_added = 0;
+
+    for (size_t position = 0; position < input.size(); position++) {
+        const auto byte = static_cast<unsigned char>(input[position]);
+        int32_t next = cache.transitions[static_cast<size_t>(state) * 256 + byte];
+
+        if (next == UNKNOWN) {
+            closure.clear(program);
+            for (const int pc: cache.states[state].pcs) {
+                if (consumes(program, program.instructions[pc], byte)) {
+                    closure.follow(program, pc + 1, false, false);
+                }
+            }
+            if (not program.anchored) {
+                closure.follow(program, 0, false, false);
+            }
+            std::ranges::sort(closure.pcs);
+
+            next = add_state(closure.pcs);
+            if (next == UNKNOWN) {
+                // Give up if the cache keeps filling up faster than it saves work.
+                if (++flushes >= MIN_FLUSHES and position < MIN_BYTES_PER_STATE * states_added) {
+                    return Result::GaveUp;
+                }
+
+                const std::vector<int> pcs = closure.pcs;
+                cache.clear();
+                closure.clear(program);
+                closure.pcs = pcs;
+                next = add_state(pcs);
+                if (next == UNKNOWN) {
+                    return Result::GaveUp;
+                }
+            } else {
+                cache.transitions[static_cast<size_t>(state) * 256 + byte] = next;
+            }
+            states_added++;
+        }
+
+        state = next;
+        const State &current = cache.states[state];
+
+        if (current.is_match) {
+            return Result::Match;
+        }
+        if (current.pcs.empty()) {
+            return Result::NoMatch;
+        }
+    }
+
+    return cache.states[state].match_at_end ? Result::Match : Result::NoMatch;
+}
@@ -1,14 +1,14 @@
 #include "Matcher.hpp"
 
 
-bool Matcher::match_pattern(const std::string &input, const std::string &pattern) {
-    auto root = tokenize(pattern);
-    std::cout << root->to_string(0) << '\n';
+CompiledPattern Matcher::compile(const std::string &pattern, const PatternConfig &config) {
+    return CompiledPattern(pattern, config);
+}
 
-    auto positions = std::views::iota(0, (int)input.size());
+PatternSet Matcher::compile_set(const std::vector<std::string> &patterns, const PatternConfig &config) {
+    return PatternSet(patterns, config);
+}
 
-    return std::ranges::any_of(positions, [&](size_t position) {
-        Backreference backreference;
-        return root->get_matches(MatchContext(input, position, backreference)).has_matched();
-    });
+bool Matcher::match_pattern(std::string_view input, const std::string &pattern) {
+    return compile(pattern).match(input);
 }
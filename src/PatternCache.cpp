@@ -0,0 +1,44 @@
+#include "PatternCache.hpp"
+
+#include <vector>
+
+#include "input.hpp"
+
+
+PatternCache::PatternCache(PatternConfig config, const size_t capacity)
+        : config(std::move(config)), capacity(std::max<size_t>(capacity, 1)) {}
+
+std::shared_ptr<const PatternSet> PatternCache::get(const std::string &text) {
+    {
+        std::lock_guard lock(mutex);
+        if (const auto found = index.find(text); found != index.end()) {
+            entries.splice(entries.begin(), entries, found->second);
+            return found->second->second;
+        }
+    }
+
+    std::vector<std::string> patterns;
+    for_each_line(text, [&](const std::string_view line) {
+        patterns.emplace_back(line);
+        return true;
+    });
+    if (patterns.empty()) {
+        patterns.emplace_back();
+    }
+    auto compiled = std::make_shared<const PatternSet>(patterns, config);
+
+    std::lock_guard lock(mutex);
+    // Another thread may have compiled the same text meanwhile; keep the first copy.
+    if (const auto found = index.find(text); found != index.end()) {
+        entries.splice(entries.begin(), entries, found->second);
+        return found->second->second;
+    }
+
+    entries.emplace_front(text, std::move(compiled));
+    index.emplace(entries.front().first, entries.begin());
+    if (entries.size() > capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+    return entries.front().second;
+}
@@ -0,0 +1,198 @@
+#include "PatternSet.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "input.hpp"
+
+
+PatternSet::PatternSet(const std::vector<std::string> &texts, const PatternConfig &config) {
+    std::vector<std::string> keys;
+    std::unordered_map<std::string, size_t> key_ids;
+
+    // A newline separates patterns, as lines never hold one. No literal of a pattern, and so no key of
+    // the automaton, contains a newline then.
+    std::vector<std::string> lines;
+    for (const auto &text: texts) {
+        for_each_line(text, [&](const std::string_view line) {
+            lines.emplace_back(line);
+            return true;
+        });
+        if (text.empty() or text.back() == '\n') {
+            lines.emplace_back();
+        }
+    }
+
+    patterns.reserve(lines.size());
+    for (const auto &text: lines) {
+        patterns.emplace_back(text, config);
+        const size_t index = patterns.size() - 1;
+
+        const LiteralSearcher *prefilter = patterns.back().prefilter();
+        if (prefilter == nullptr) {
+            unkeyed.push_back(index);
+            continue;
+        }
+
+        const auto [found, inserted] = key_ids.try_emplace(prefilter->literal(), keys.size());
+        if (inserted) {
+            keys.push_back(prefilter->literal());
+            patterns_by_key.emplace_back();
+        }
+        patterns_by_key[found->second].push_back(index);
+    }
+
+    automaton = AhoCorasick(keys);
+}
+
+bool PatternSet::match_candidates(std::string_view line, std::vector<int32_t> &found_keys, Dfas &dfas) const {
+    std::ranges::sort(found_keys);
+    const auto duplicates = std::ranges::unique(found_keys);
+    found_keys.erase(duplicates.begin(), duplicates.end());
+
+    for (const int32_t key: found_keys) {
+        for (const size_t index: patterns_by_key[key]) {
+            if (patterns[index].match_prefiltered(line, dfas[index])) {
+                return true;
+            }
+        }
+    }
+
+    return std::ranges::any_of(unkeyed, [&](const size_t index) {
+        return patterns[index].match(line, dfas[index]);
+    });
+}
+
+bool PatternSet::match(std::string_view input) const {
+    Dfas dfas(patterns.size());
+    return match(input, dfas);
+}
+
+bool PatternSet::match(std::string_view input, Dfas &dfas) const {
+    thread_local std::vector<int32_t> found_keys;
+    found_keys.clear();
+
+    uint32_t state = AhoCorasick::START;
+    for (const char byte: input) {
+        state = automaton.next(state, static_cast<unsigned char>(byte));
+        if (automaton.has_output(state)) {
+            automaton.for_each_key(state, [&](const int32_t key) {
+                found_keys.push_back(key);
+            });
+        }
+    }
+
+    return match_candidates(input, found_keys, dfas);
+}
+
+size_t PatternSet::match_lines(const std::span<const std::string_view> lines, const std::span<uint64_t> matches) const {
+    if (patterns.size() == 1) {
+        return patterns.front().match_lines(lines, matches);
+    }
+    if (matches.size() < bitmap_words(lines.size())) {
+        throw std::invalid_argument("match_lines: bitmap too small for the lines");
+    }
+    std::fill_n(matches.begin(), bitmap_words(lines.size()), 0);
+
+    Dfas dfas(patterns.size());
+    size_t count = 0;
+    for (size_t index = 0; index < lines.size(); index++) {
+        if (match(lines[index], dfas)) {
+            matches[index / 64] |= uint64_t{1} << (index % 64);
+            count++;
+        }
+    }
+    return count;
+}
+
+std::pair<size_t, size_t> PatternSet::find_line(std::string_view block, size_t from) const {
+    auto line_at = [&](const size_t begin) {
+        const auto *newline = static_cast<const char *>(std::memchr(block.data() + begin, '\n', block.size() - begin));
+        return std::pair<size_t, size_t>(begin, (newline != nullptr ? newline - block.data() : block.size()) - begin);
+    };
+
+    Dfas dfas(patterns.size());
+
+    // Patterns without a literal can match any line, so every line is checked.
+    if (not unkeyed.empty()) {
+        while (from < block.size()) {
+            const auto line = line_at(from);
+            if (match(block.substr(line.first, line.second), dfas)) {
+                return line;
+            }
+            from = line.first + line.second + 1;
+        }
+        return {std::string_view::npos, 0};
+    }
+
+    // Otherwise only the lines where the automaton finds a key are. Keys never hold a newline, so the
+    // automaton is back at its start state at every line boundary.
+    thread_local std::vector<int32_t> found_keys;
+    uint32_t state = AhoCorasick::START;
+
+    for (size_t position = from; position < block.size(); position++) {
+        state = automaton.next(state, static_cast<unsigned char>(block[position]));
+        if (not automaton.has_output(state)) {
+            continue;
+        }
+
+        const auto *previous_newline = static_cast<const char *>(memrchr(block.data() + from, '\n', position - from));
+        const size_t begin = previous_newline != nullptr ? previous_newline - block.data() + 1 : from;
+        const auto line = line_at(begin);
+        const size_t end = line.first + line.second;
+
+        // Collect every key of the line before running the patterns they select.
+        found_keys.clear();
+        while (true) {
+            automaton.for_each_key(state, [&](const int32_t key) {
+                found_keys.push_back(key);
+            });
+            if (++position >= end) {
+                break;
+            }
+            state = automaton.next(state, static_cast<unsigned char>(block[position]));
+        }
+
+        if (match_candidates(block.substr(line.first, line.second), found_keys, dfas)) {
+            return line;
+        }
+
+        from = end + 1;
+        position = end;
+        state = AhoCorasick::START;
+    }
+
+    return {std::string_view::npos, 0};
+}
+
+std::optional<Span> PatternSet::find(std::string_view input, const size_t from) const {
+    std::optional<Span> first;
+
+    for (const auto &pattern: patterns) {
+        const std::optional<Span> span = pattern.find(input, from);
+        if (span and (not first or span->first < first->first
+                      or (span->first == first->first and span->second > first->second))) {
+            first = span;
+        }
+    }
+
+    return first;
+}
+
+TrigramQuery PatternSet::trigram_query() const {
+    std::vector<TrigramQuery> queries;
+    for (const auto &pattern: patterns) {
+        queries.push_back(pattern.trigram_query());
+    }
+    return TrigramQuery::any_of(std::move(queries));
+}
+
+std::string PatternSet::to_string() const {
+    std::string str;
+    for (const auto &pattern: patterns) {
+        str += pattern.to_string();
+    }
+    return str;
+}
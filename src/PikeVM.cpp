@@ -0,0 +1,170 @@
+#include "PikeVM.hpp"
+
+#include <algorithm>
+
+
+namespace {
+    // Ordered set of NFA threads, each with its own capture slots
+    struct ThreadList {
+        std::vector<int> sparse;    // pc -> index into dense
+        std::vector<int> dense;     // pcs in priority order
+        std::vector<size_t> slots;  // slot_count positions per thread
+        size_t size = 0;
+
+        void reset(const size_t instruction_count, const size_t slot_count) {
+            sparse.resize(instruction_count);
+            dense.resize(instruction_count);
+            slots.resize(instruction_count * slot_count);
+            size = 0;
+        }
+
+        [[nodiscard]] bool contains(const int pc) const {
+            const auto index = static_cast<size_t>(sparse[pc]);
+            return index < size and dense[index] == pc;
+        }
+
+        size_t insert(const int pc) {
+            sparse[pc] = static_cast<int>(size);
+            dense[size] = pc;
+            return size++;
+        }
+    };
+
+    // Pending work of the epsilon closure: explore a pc, or undo a Save on the way back
+    struct Frame {
+        bool restore;
+        int index;
+        size_t value;
+    };
+
+    // Working memory reused by every search on the same thread
+    struct Scratch {
+        ThreadList current;
+        ThreadList next;
+        std::vector<size_t> slots;
+        std::vector<Frame> stack;
+    };
+
+    thread_local Scratch scratch;
+}
+
+
+bool PikeVM::search(std::string_view input, std::vector<size_t> *captures, const size_t from) const {
+    const auto &instructions = program.instructions;
+    const size_t slot_count = (captures != nullptr) ? program.slot_count() : 0;
+
+    auto &[current, next, slots, stack] = scratch;
+    current.reset(instructions.size(), slot_count);
+    next.reset(instructions.size(), slot_count);
+    slots.resize(slot_count);
+
+    // Adds the thread at start_pc and everything reachable from it without consuming input.
+    auto add_thread = [&](ThreadList &list, const int start_pc, const size_t position) {
+        stack.push_back({false, start_pc, 0});
+
+        while (not stack.empty()) {
+            const Frame frame = stack.back();
+            stack.pop_back();
+
+            if (frame.restore) {
+                slots[frame.index] = frame.value;
+                continue;
+            }
+
+            int pc = frame.index;
+            bool follow = true;
+            while (follow and not list.contains(pc)) {
+                const size_t thread = list.insert(pc);
+                const Instruction &instruction = instructions[pc];
+
+                switch (instruction.opcode) {
+                    case Opcode::Jump:
+                        pc = instruction.argument;
+                        break;
+                    case Opcode::Split:
+                        stack.push_back({false, instruction.alternative, 0});
+                        pc = instruction.argument;
+                        break;
+                    case Opcode::Loop:
+                        // An empty iteration comes back to a pc already in the list, which ends it.
+                        stack.push_back({false, pc + 1, 0});
+                        pc = instruction.argument;
+                        break;
+                    case Opcode::AtomicBegin:
+                    case Opcode::AtomicEnd:
+                        // Only implied atomic groups get here, and they don't change what matches.
+                        pc++;
+                        break;
+                    case Opcode::Save:
+                        if (static_cast<size_t>(instruction.argument) < slot_count) {
+                            stack.push_back({true, instruction.argument, slots[instruction.argument]});
+                            slots[instruction.argument] = position;
+                        }
+                        pc++;
+                        break;
+                    case Opcode::AssertBegin:
+                        follow = position == 0;
+                        pc++;
+                        break;
+                    case Opcode::AssertEnd:
+                        follow = position == input.size();
+                        pc++;
+                        break;
+                    default:
+                        std::ranges::copy(slots, list.slots.begin() + static_cast<long>(thread * slot_count));
+                        follow = false;
+                        break;
+                }
+            }
+        }
+    };
+
+    bool matched = false;
+
+    for (size_t position = from; position <= input.size(); position++) {
+        // A new search starts at every position, with lower priority than the threads already running.
+        if (not matched and (position == 0 or not program.anchored)) {
+            std::ranges::fill(slots, std::string_view::npos);
+            add_thread(current, 0, position);
+        }
+
+        if (current.size == 0 and (matched or program.anchored)) {
+            break;
+        }
+
+        for (size_t thread = 0; thread < current.size; thread++) {
+            const Instruction &instruction = instructions[current.dense[thread]];
+            const auto thread_slots = current.slots.begin() + static_cast<long>(thread * slot_count);
+
+            if (instruction.opcode == Opcode::Match) {
+                matched = true;
+                if (captures == nullptr) {
+                    return true;
+                }
+
+                // Lower priority threads can no longer win.
+                captures->assign(thread_slots, thread_slots + static_cast<long>(slot_count));
+                break;
+            }
+
+            if (position == input.size()) {
+                continue;
+            }
+
+            const auto byte = static_cast<unsigned char>(input[position]);
+            const bool consumes = (instruction.opcode == Opcode::Char and input[position] == instruction.literal)
+                                  or (instruction.opcode == Opcode::Class and program.classes[instruction.argument][byte])
+                                  or instruction.opcode == Opcode::Any;
+
+            if (consumes) {
+                std::copy(thread_slots, thread_slots + static_cast<long>(slot_count), slots.begin());
+                add_thread(next, current.dense[thread] + 1, position + 1);
+            }
+        }
+
+        std::swap(current, next);
+        next.size = 0;
+    }
+
+    return matched;
+}
@@ -1,31 +1,495 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 
+#include "daemon.hpp"
+#include "input.hpp"
 #include "Matcher.hpp"
+#include "options.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
+#include "search.hpp"
+#include "stats.hpp"
+#include "ThreadPool.hpp"
+#include "tokenizer.hpp"
+#include "TrigramIndex.hpp"
+#include "walk.hpp"
 
 
-int main(int argc, char *argv[]) {
-    // Flush after every std::cout / std::cerr
-    std::cout << std::unitbuf;
-    std::cerr << std::unitbuf;
+// Set when a line was given up on for exceeding the matching budget
+static std::atomic<bool> budget_exceeded = false;
 
-    if (argc != 3) {
-        std::cerr << "Expected two arguments" << std::endl;
-        return 1;
+// Same, for the searches of the current thread; daemon requests report it in their own status
+static thread_local bool thread_budget_exceeded = false;
+
+// Reports a line given up on; called from any searching thread
+static void report_budget_exceeded(const std::string_view line) {
+    static std::mutex report_mutex;
+    constexpr size_t SHOWN = 60;
+
+    budget_exceeded = true;
+    thread_budget_exceeded = true;
+    std::lock_guard lock(report_mutex);
+    std::cerr << "server: matching budget exceeded, line skipped: " << line.substr(0, SHOWN)
+              << (line.size() > SHOWN ? "..." : "") << std::endl;
+}
+
+static size_t thread_count(const Options &options) {
+    return options.threads != 0 ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+// Opens an input, counted as I/O by --stats
+static std::unique_ptr<InputSource> open_timed(const std::string &path) {
+    const PhaseTimer timer(StatPhase::Io);
+    return open_input(path);
+}
+
+// Next block of the source, counted as I/O by --stats
+static std::string_view read_block(InputSource &source) {
+    const PhaseTimer timer(StatPhase::Io);
+    const std::string_view block = source.next_block();
+    count_input(block);
+    return block;
+}
+
+// Writes the --stats report, returns false if its file can't be written
+static bool write_stats(const Options &options) {
+    if (options.stats_path.empty()) {
+        std::cerr << stats_json();
+        return true;
+    }
+
+    std::ofstream file(options.stats_path);
+    file << stats_json();
+    file.close();
+    if (not file) {
+        std::cerr << "server: " << options.stats_path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Whether output lines start with the name of their file, like grep with several operands
+static bool with_file_names(const Options &options) {
+    return options.recursive or options.files.size() > 1;
+}
+
+// Searches one input and formats its results into output (a BufferedWriter or a std::string): the
+// matching lines, or only their matches with -o, prefixed with the file name and line number as
+// asked; their count with -c; or the file name with -l. -q prints nothing. Returns the number of
+// matching lines, stopping at the first one with -l or -q. Blocks large enough to split are scanned
+// on the pool, started on demand, when pool is not null.
+template <typename Output>
+static size_t search_input(const PatternSet &pattern, const Options &options, InputSource &source, Output &output,
+                           std::optional<ThreadPool> *pool) {
+    const bool stop_at_first = options.quiet or options.list_files;
+    const bool print_lines = not stop_at_first and not options.count;
+    const std::string prefix = with_file_names(options) ? source.name + ':' : std::string();
+    size_t matches = 0;
+
+    auto print = [&](const std::string_view text, const size_t line_number) {
+        output.append(prefix);
+        if (options.line_numbers) {
+            append_number(output, line_number);
+            output.append(":");
+        }
+        output.append(text);
+        output.append("\n");
+    };
+
+    auto on_match = [&](const std::string_view line, const size_t line_number) {
+        matches++;
+        if (print_lines and not options.only_matching) {
+            print(line, line_number);
+        } else if (print_lines) {
+            // Empty matches are skipped, one position at a time.
+            for (auto span = pattern.find(line); span; span = pattern.find(line, std::max(span->second, span->first + 1))) {
+                if (span->second > span->first) {
+                    print(line.substr(span->first, span->second - span->first), line_number);
+                }
+                if (span->second >= line.size()) {
+                    break;
+                }
+            }
+        }
+        return not stop_at_first;
+    };
+    auto on_numbered_match = [&](const LineMatch &match) {
+        return on_match(match.line, match.number);
+    };
+
+    size_t line_number = 1;
+    bool first_block = true;
+    for (auto block = read_block(source); not block.empty(); block = read_block(source)) {
+        if (options.recursive and first_block and looks_binary(block)) {
+            return 0;
+        }
+        first_block = false;
+        if (source.block_first_line() != 0) {
+            line_number = source.block_first_line();
+        }
+
+        if (pool != nullptr and not *pool and block.size() >= 2 * options.chunk_size) {
+            pool->emplace(thread_count(options));
+        }
+
+        // Lines are only counted when their numbers are printed.
+        const PhaseTimer timer(StatPhase::Match);
+        bool completed;
+        if (pool != nullptr and *pool) {
+            completed = for_each_matching_line_parallel(pattern, block, **pool, line_number, on_numbered_match,
+                                                        options.chunk_size);
+        } else if (options.line_numbers) {
+            completed = for_each_numbered_match(pattern, block, line_number, on_numbered_match);
+        } else {
+            completed = for_each_matching_line(pattern, block, [&](const std::string_view line) {
+                return on_match(line, 0);
+            });
+        }
+        if (not completed) {
+            break;
+        }
     }
 
-    const std::string flag = argv[1];
-    const std::string pattern = argv[2];
+    if (options.list_files and not options.quiet and matches > 0) {
+        output.append(source.name);
+        output.append("\n");
+    } else if (options.count and not stop_at_first) {
+        output.append(prefix);
+        append_number(output, matches);
+        output.append("\n");
+    }
+    return matches;
+}
+
+// Searches the operands on a thread pool, walking directories and skipping binary files. The output
+// of a file is written at once, so files never interleave.
+static int search_recursive(const PatternSet &pattern, const Options &options, BufferedWriter &output) {
+    std::atomic<bool> matched = false;
+    std::atomic<bool> had_error = false;
+    std::mutex output_mutex;
+
+    ThreadPool pool(thread_count(options));
+
+    auto report_error = [&](const std::string &path) {
+        const int error = errno;
+        std::lock_guard lock(output_mutex);
+        std::cerr << "server: " << path << ": " << std::strerror(error) << std::endl;
+        had_error = true;
+    };
+
+    auto search_file = [&](const std::string &path) {
+        // With -q the first match decides; the files still queued are dropped.
+        if (options.quiet and matched) {
+            return;
+        }
+
+        auto source = open_timed(path);
+        if (source == nullptr) {
+            report_error(path);
+            return;
+        }
+
+        std::string file_output;
+        if (search_input(pattern, options, *source, file_output, nullptr) > 0) {
+            matched = true;
+        }
+
+        if (source->failed()) {
+            report_error(path);
+        }
+        if (not file_output.empty()) {
+            std::lock_guard lock(output_mutex);
+            output.append(file_output);
+        }
+    };
+
+    const WalkCallbacks callbacks{
+            [&](std::string path) {
+                pool.submit([&search_file, path = std::move(path)] {
+                    search_file(path);
+                });
+            },
+            report_error,
+    };
+
+    for (const auto &path: options.files) {
+        struct stat status{};
+        if (path != "-" and stat(path.c_str(), &status) == 0 and S_ISDIR(status.st_mode)) {
+            pool.submit([&pool, &callbacks, &path] {
+                walk_directory(pool, path, callbacks);
+            });
+        } else {
+            callbacks.on_file(path);
+        }
+    }
+
+    pool.wait();
+
+    if (options.quiet and matched) {
+        return 0;
+    }
+    if (had_error) {
+        return 2;
+    }
+
+    return (matched) ? 0 : 1;
+}
+
+
+// Searches the operands one after the other, writing their results as they are found
+static int search_files(const PatternSet &pattern, const Options &options, BufferedWriter &output) {
+    bool matched = false;
+    bool had_error = false;
+    std::optional<ThreadPool> pool; // started for the first block large enough to split
+
+    for (const auto &path: options.files) {
+        auto source = open_timed(path);
+        if (source == nullptr) {
+            std::cerr << "server: " << path << ": " << std::strerror(errno) << std::endl;
+            had_error = true;
+            continue;
+        }
+
+        if (search_input(pattern, options, *source, output, &pool) > 0) {
+            matched = true;
+            if (options.quiet) {
+                return 0;
+            }
+        }
+
+        if (source->failed()) {
+            std::cerr << "server: " << source->name << ": " << std::strerror(errno) << std::endl;
+            had_error = true;
+        }
+    }
 
-    if (flag != "-E") {
-        std::cerr << "Expected first argument to be '-E'" << std::endl;
+    if (had_error) {
+        return 2;
+    }
+
+    return (matched) ? 0 : 1;
+}
+
+
+// Searches the files of the index given with --index, reading only the blocks that may hold a match.
+// Files changed since they were indexed are searched whole; files appended to, from their last
+// indexed block on.
+static int search_indexed(const PatternSet &pattern, Options options, BufferedWriter &output) {
+    const auto index = TrigramIndex::open(options.index_path);
+    if (index == nullptr) {
+        std::cerr << "server: " << options.index_path << ": " << std::strerror(errno) << std::endl;
+        return 2;
+    }
+
+    const TrigramQuery query = pattern.trigram_query();
+    const auto candidates = index->candidates(query);
+    if (options.debug) {
+        std::cerr << "trigrams: " << query.to_string() << ", "
+                  << (candidates ? candidates->size() : index->blocks()) << " of " << index->blocks()
+                  << " blocks" << std::endl;
+    }
+
+    // File names are printed as for operands.
+    for (const auto &file: index->indexed_files()) {
+        options.files.push_back(file.path);
+    }
+
+    bool matched = false;
+    bool had_error = false;
+    std::optional<ThreadPool> pool;
+    auto next_candidate = candidates ? candidates->begin() : std::vector<uint32_t>::const_iterator();
+
+    for (const auto &file: index->indexed_files()) {
+        // Candidate blocks of the file, in order
+        std::vector<IndexedSource::Range> ranges;
+        const uint32_t end_block = file.first_block + file.block_count;
+        auto add_range = [&](const uint32_t number) {
+            const TrigramIndex::Block block = index->block(number);
+            ranges.push_back({block.offset, block.length, block.first_line});
+        };
+        if (candidates) {
+            next_candidate = std::lower_bound(next_candidate, candidates->cend(), file.first_block);
+            for (; next_candidate != candidates->cend() and *next_candidate < end_block; ++next_candidate) {
+                add_range(*next_candidate);
+            }
+        } else {
+            for (uint32_t number = file.first_block; number < end_block; number++) {
+                add_range(number);
+            }
+        }
+
+        std::unique_ptr<InputSource> source;
+        switch (TrigramIndex::Change change = TrigramIndex::change_of(file)) {
+            case TrigramIndex::Change::Missing:
+                break;
+            case TrigramIndex::Change::Changed:
+                source = open_timed(file.path);
+                break;
+            case TrigramIndex::Change::Unchanged:
+            case TrigramIndex::Change::Appended:
+                if (file.compressed) {
+                    source = ranges.empty() ? std::make_unique<IndexedSource>(file.path, std::move(ranges))
+                                            : open_timed(file.path);
+                    break;
+                }
+                // The last block and the lines after it were never indexed together.
+                if (change == TrigramIndex::Change::Appended) {
+                    if (file.block_count == 0) {
+                        // A file indexed empty has no last block: all of it is new.
+                        ranges.push_back({0, UINT64_MAX, 1});
+                    } else if (const TrigramIndex::Block last = index->block(end_block - 1);
+                            not ranges.empty() and ranges.back().offset == last.offset) {
+                        ranges.back().length = UINT64_MAX;
+                    } else {
+                        ranges.push_back({last.offset, UINT64_MAX, last.first_line});
+                    }
+                }
+                source = std::make_unique<IndexedSource>(file.path, std::move(ranges));
+                break;
+        }
+        if (source == nullptr) {
+            std::cerr << "server: " << file.path << ": " << std::strerror(errno) << std::endl;
+            had_error = true;
+            continue;
+        }
+
+        if (search_input(pattern, options, *source, output, &pool) > 0) {
+            matched = true;
+            if (options.quiet) {
+                return 0;
+            }
+        }
+
+        if (source->failed()) {
+            std::cerr << "server: " << source->name << ": " << std::strerror(errno) << std::endl;
+            had_error = true;
+        }
+    }
+
+    if (had_error) {
+        return 2;
+    }
+
+    return (matched) ? 0 : 1;
+}
+
+// Builds or updates the index given with --build-index from the operands, walking directories
+static int build_index(const Options &options) {
+    std::vector<std::string> files;
+    std::mutex files_mutex;
+    std::atomic<bool> had_error = false;
+
+    auto report_error = [&](const std::string &path) {
+        const int error = errno;
+        std::lock_guard lock(files_mutex);
+        std::cerr << "server: " << path << ": " << std::strerror(error) << std::endl;
+        had_error = true;
+    };
+
+    {
+        ThreadPool pool(thread_count(options));
+        const WalkCallbacks callbacks{
+                [&](std::string path) {
+                    std::lock_guard lock(files_mutex);
+                    files.push_back(std::move(path));
+                },
+                report_error,
+        };
+        for (const auto &path: options.files) {
+            struct stat status{};
+            if (stat(path.c_str(), &status) == 0 and S_ISDIR(status.st_mode)) {
+                pool.submit([&pool, &callbacks, &path] {
+                    walk_directory(pool, path, callbacks);
+                });
+            } else {
+                callbacks.on_file(path);
+            }
+        }
+        pool.wait();
+    }
+
+    IndexUpdate update;
+    if (not update_index(options.index_path, files, report_error, update)) {
+        std::cerr << "server: " << options.index_path << ": " << std::strerror(errno) << std::endl;
+        return 2;
+    }
+    if (options.debug) {
+        std::cerr << "indexed " << update.indexed << " files, " << update.appended << " appended, "
+                  << update.unchanged << " unchanged, " << update.skipped << " binary skipped" << std::endl;
+    }
+
+    return had_error ? 2 : 0;
+}
+
+
+// Searches the input of a daemon request, see RequestSearch
+static int search_request(const PatternSet &pattern, const Options &options, InputSource &source, std::string &output) {
+    thread_budget_exceeded = false;
+    if (search_input(pattern, options, source, output, nullptr) > 0) {
+        return 0;
+    }
+    return thread_budget_exceeded ? 3 : 1;
+}
+
+
+int main(int argc, char *argv[]) {
+    Options options;
+    if (not parse_options(argc, argv, options)) {
         return 1;
     }
 
-    std::string input_line;
-    std::getline(std::cin, input_line);
+    options.pattern_config.on_budget_exceeded = report_budget_exceeded;
+    stats_enabled = options.stats;
 
-    const bool matches_pattern = Matcher::match_pattern(input_line, pattern);
+    if (not options.daemon_socket.empty()) {
+        return run_daemon(options, search_request);
+    }
+    if (options.build_index) {
+        return build_index(options);
+    }
+
+    std::optional<PatternSet> compiled;
+    try {
+        const PhaseTimer timer(StatPhase::Compile);
+        compiled.emplace(Matcher::compile_set(options.patterns, options.pattern_config));
+    } catch (const PatternError &error) {
+        std::cerr << "server: invalid pattern '" << error.pattern() << "': " << error.what() << std::endl;
+        return 2;
+    }
+
+    const PatternSet &pattern = *compiled;
+    if (options.debug) {
+        std::cerr << pattern.to_string();
+    }
 
-    return (matches_pattern) ? 0 : 1;
+    BufferedWriter output(STDOUT_FILENO);
+    int status;
+    if (not options.index_path.empty()) {
+        status = search_indexed(pattern, options, output);
+    } else {
+        status = options.recursive ? search_recursive(pattern, options, output) : search_files(pattern, options, output);
+    }
+    if (not output.flush()) {
+        std::cerr << "server: write error: " << std::strerror(errno) << std::endl;
+        return 2;
+    }
+    if (options.stats and not write_stats(options)) {
+        return 2;
+    }
+
+    // No match found, but a skipped line might have matched: the answer is unknown.
+    if (status == 1 and budget_exceeded) {
+        status = 3;
+    }
+    return status;
 }
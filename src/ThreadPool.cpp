@@ -0,0 +1,106 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+
+namespace {
+    // Pool and worker the current thread belongs to, if any
+    thread_local const ThreadPool *current_pool = nullptr;
+    thread_local size_t current_worker = 0;
+}
+
+
+ThreadPool::ThreadPool(const size_t thread_count) {
+    const size_t count = std::max<size_t>(thread_count, 1);
+
+    for (size_t index = 0; index < count; index++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t index = 0; index < count; index++) {
+        threads.emplace_back([this, index] {
+            run(index);
+        });
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    const size_t target = (current_pool == this) ? current_worker : next_worker++ % workers.size();
+
+    pending++;
+    queued++;
+    {
+        std::lock_guard lock(workers[target]->mutex);
+        workers[target]->tasks.push_back(std::move(task));
+    }
+
+    // Taking the lock orders the notification after any worker that just found nothing to do went to sleep.
+    { std::lock_guard lock(idle_mutex); }
+    wake.notify_one();
+}
+
+bool ThreadPool::take(const size_t self, Task &task) {
+    // Own deque from the back, then the others' from the front.
+    for (size_t offset = 0; offset < workers.size(); offset++) {
+        Worker &worker = *workers[(self + offset) % workers.size()];
+        std::lock_guard lock(worker.mutex);
+
+        if (not worker.tasks.empty()) {
+            if (offset == 0) {
+                task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+            } else {
+                task = std::move(worker.tasks.front());
+                worker.tasks.pop_front();
+            }
+            queued--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::run(const size_t self) {
+    current_pool = this;
+    current_worker = self;
+
+    while (true) {
+        Task task;
+        if (take(self, task)) {
+            task();
+
+            if (--pending == 0) {
+                std::lock_guard lock(idle_mutex);
+                settled.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock lock(idle_mutex);
+        wake.wait(lock, [&] {
+            return stopping or queued > 0;
+        });
+        if (stopping and queued == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::wait() {
+    std::unique_lock lock(idle_mutex);
+    settled.wait(lock, [&] {
+        return pending == 0;
+    });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(idle_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto &thread: threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,760 @@
+#include "TrigramIndex.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "compressed.hpp"
+
+
+namespace {
+
+constexpr char MAGIC[8] = {'G', 'R', 'P', 'I', 'D', 'X', '0', '1'};
+
+struct Header {
+    char magic[8];
+    uint64_t file_count;
+    uint64_t block_count;
+    uint64_t trigram_count;
+    uint64_t blocks_offset;
+    uint64_t trigrams_offset;
+    uint64_t postings_offset;
+    uint64_t size;
+};
+
+// Followed by the path, padded to 8 bytes
+struct FileRecord {
+    uint64_t size;
+    int64_t mtime;
+    uint64_t tail_hash;
+    uint32_t first_block;
+    uint32_t block_count;
+    uint32_t flags;
+    uint32_t path_size;
+};
+
+constexpr uint32_t FILE_COMPRESSED = 1;
+
+struct BlockRecord {
+    uint64_t offset;
+    uint64_t length;
+    uint64_t first_line;
+    uint64_t line_count;
+    uint32_t file;
+    uint32_t reserved;
+};
+
+struct TrigramRecord {
+    uint32_t trigram;
+    uint32_t count;
+    uint64_t postings; // offset in the postings section
+};
+
+constexpr size_t padded(const size_t size) {
+    return (size + 7) & ~size_t{7};
+}
+
+template <typename Record>
+Record read_record(const char *data) {
+    Record record;
+    std::memcpy(&record, data, sizeof(record));
+    return record;
+}
+
+template <typename Record>
+void append_record(std::string &out, const Record &record) {
+    out.append(reinterpret_cast<const char *>(&record), sizeof(record));
+}
+
+void append_varint(std::string &out, uint32_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+// FNV-1a
+uint64_t hash_bytes(const std::string_view bytes) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const char byte: bytes) {
+        hash = (hash ^ static_cast<unsigned char>(byte)) * 0x100000001b3;
+    }
+    return hash;
+}
+
+// Hash of the TAIL_SIZE bytes before end, or nullopt if they can't be read
+std::optional<uint64_t> tail_hash(const int fd, const uint64_t end) {
+    char tail[TrigramIndex::TAIL_SIZE];
+    const size_t size = std::min<uint64_t>(end, sizeof(tail));
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t count = pread(fd, tail + done, size - done, static_cast<off_t>(end - size + done));
+        if (count < 0 and errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return std::nullopt;
+        }
+        done += count;
+    }
+    return hash_bytes({tail, size});
+}
+
+int64_t mtime_of(const struct stat &info) {
+    return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+bool write_all(const int fd, std::string_view data) {
+    while (not data.empty()) {
+        const ssize_t count = write(fd, data.data(), data.size());
+        if (count < 0 and errno != EINTR) {
+            return false;
+        }
+        data.remove_prefix(std::max<ssize_t>(count, 0));
+    }
+    return true;
+}
+
+// Read-only mapping of a whole file, empty for an empty file
+class Mapping {
+private:
+    void *data = MAP_FAILED;
+    size_t size = 0;
+
+public:
+    bool map(const int fd, const size_t length) {
+        size = length;
+        if (length == 0) {
+            return true;
+        }
+        data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        return data != MAP_FAILED;
+    }
+
+    [[nodiscard]] std::string_view text() const {
+        return (data != MAP_FAILED) ? std::string_view(static_cast<const char *>(data), size) : std::string_view();
+    }
+
+    ~Mapping() {
+        if (data != MAP_FAILED) {
+            munmap(data, size);
+        }
+    }
+};
+
+// Trigrams and blocks of the index being built. The trigrams of a block are collected in a bitset,
+// so each block appears once in a posting list however often the trigram occurs in it.
+class IndexBuilder {
+private:
+    std::vector<uint64_t> seen = std::vector<uint64_t>((1 << 24) / 64);
+    std::vector<uint32_t> touched; // set bits of seen
+
+public:
+    std::vector<TrigramIndex::File> files;
+    std::vector<TrigramIndex::Block> blocks;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+
+    // Collects the trigrams of text, made of whole lines, into the current block
+    void add_text(const std::string_view text) {
+        uint32_t trigram = 0;
+        size_t run = 0; // bytes since the last newline
+        for (const char byte: text) {
+            if (byte == '\n') {
+                run = 0;
+                continue;
+            }
+            trigram = (trigram << 8 | static_cast<unsigned char>(byte)) & 0xffffff;
+            if (++run >= 3) {
+                uint64_t &word = seen[trigram >> 6];
+                const uint64_t bit = uint64_t{1} << (trigram & 63);
+                if ((word & bit) == 0) {
+                    word |= bit;
+                    touched.push_back(trigram);
+                }
+            }
+        }
+    }
+
+    // Ends the current block, recording it with the trigrams collected since the last one
+    void end_block(const TrigramIndex::Block &block) {
+        const auto number = static_cast<uint32_t>(blocks.size());
+        blocks.push_back(block);
+        for (const uint32_t trigram: touched) {
+            postings[trigram].push_back(number);
+            seen[trigram >> 6] = 0;
+        }
+        touched.clear();
+    }
+
+    // Forgets the trigrams collected since the last block
+    void discard_block() {
+        for (const uint32_t trigram: touched) {
+            seen[trigram >> 6] = 0;
+        }
+        touched.clear();
+    }
+
+    // Cuts text into blocks from offset on, the line there being first_line
+    void index_text(const std::string_view text, uint64_t offset, uint64_t first_line, const uint32_t file) {
+        while (offset < text.size()) {
+            uint64_t end = std::min<uint64_t>(offset + TrigramIndex::BLOCK_SIZE, text.size());
+            if (end < text.size()) {
+                // End after the last newline, or after the first one if a single line is longer.
+                const auto *newline = static_cast<const char *>(memrchr(text.data() + offset, '\n', end - offset));
+                if (newline == nullptr) {
+                    newline = static_cast<const char *>(std::memchr(text.data() + end, '\n', text.size() - end));
+                }
+                end = (newline != nullptr) ? newline - text.data() + 1 : text.size();
+            }
+
+            const std::string_view block = text.substr(offset, end - offset);
+            const uint64_t line_count = count_newlines(block) + (block.back() != '\n' ? 1 : 0);
+            add_text(block);
+            end_block({offset, end - offset, first_line, line_count, file});
+            offset = end;
+            first_line += line_count;
+        }
+    }
+
+    // Adds the postings of the blocks kept from an old index, then sorts every posting list
+    void merge(const TrigramIndex &old, const std::vector<uint32_t> &renumbered) {
+        constexpr uint32_t DROPPED = UINT32_MAX;
+        old.for_each_trigram([&](const uint32_t trigram, const std::vector<uint32_t> &old_blocks) {
+            std::vector<uint32_t> *list = nullptr;
+            for (const uint32_t block: old_blocks) {
+                if (renumbered[block] != DROPPED) {
+                    if (list == nullptr) {
+                        list = &postings[trigram];
+                    }
+                    list->push_back(renumbered[block]);
+                }
+            }
+        });
+        for (auto &[trigram, list]: postings) {
+            std::sort(list.begin(), list.end());
+        }
+    }
+
+    [[nodiscard]] std::string serialize() const {
+        std::string files_section;
+        for (const auto &file: files) {
+            append_record(files_section, FileRecord{file.size, file.mtime, file.tail_hash, file.first_block,
+                                                    file.block_count, file.compressed ? FILE_COMPRESSED : 0,
+                                                    static_cast<uint32_t>(file.path.size())});
+            files_section += file.path;
+            files_section.resize(padded(files_section.size()));
+        }
+
+        std::string blocks_section;
+        for (const auto &block: blocks) {
+            append_record(blocks_section, BlockRecord{block.offset, block.length, block.first_line,
+                                                      block.line_count, block.file, 0});
+        }
+
+        std::vector<uint32_t> trigrams;
+        trigrams.reserve(postings.size());
+        for (const auto &[trigram, list]: postings) {
+            trigrams.push_back(trigram);
+        }
+        std::sort(trigrams.begin(), trigrams.end());
+
+        std::string trigrams_section;
+        std::string postings_section;
+        for (const uint32_t trigram: trigrams) {
+            const auto &list = postings.at(trigram);
+            append_record(trigrams_section, TrigramRecord{trigram, static_cast<uint32_t>(list.size()),
+                                                          postings_section.size()});
+            uint32_t previous = 0;
+            for (const uint32_t block: list) {
+                append_varint(postings_section, block - previous);
+                previous = block;
+            }
+        }
+
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.file_count = files.size();
+        header.block_count = blocks.size();
+        header.trigram_count = trigrams.size();
+        header.blocks_offset = sizeof(Header) + files_section.size();
+        header.trigrams_offset = header.blocks_offset + blocks_section.size();
+        header.postings_offset = header.trigrams_offset + trigrams_section.size();
+        header.size = header.postings_offset + postings_section.size();
+
+        std::string out;
+        out.reserve(header.size);
+        append_record(out, header);
+        out += files_section;
+        out += blocks_section;
+        out += trigrams_section;
+        out += postings_section;
+        return out;
+    }
+};
+
+enum class Indexed {
+    Done,
+    Binary,
+    Failed, // errno is set
+};
+
+// Indexes a whole file as file number `number`, cut into blocks unless it is compressed
+Indexed index_file(IndexBuilder &builder, const std::string &path, const uint32_t number) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return Indexed::Failed;
+    }
+    struct stat info{};
+    char magic[4];
+    const ssize_t magic_size = (fstat(fd, &info) == 0) ? pread(fd, magic, sizeof(magic), 0) : -1;
+    if (magic_size < 0 or S_ISDIR(info.st_mode)) {
+        const int error = S_ISDIR(info.st_mode) ? EISDIR : errno;
+        close(fd);
+        errno = error;
+        return Indexed::Failed;
+    }
+
+    TrigramIndex::File file{path, static_cast<uint64_t>(info.st_size), mtime_of(info), 0, false,
+                            static_cast<uint32_t>(builder.blocks.size()), 0};
+
+    if (detect_compression({magic, static_cast<size_t>(magic_size)}) != Compression::None) {
+        close(fd);
+        auto source = open_input(path);
+        if (source == nullptr) {
+            return Indexed::Failed;
+        }
+        uint64_t line_count = 0;
+        bool first = true;
+        for (auto block = source->next_block(); not block.empty(); block = source->next_block()) {
+            if (first and looks_binary(block)) {
+                builder.discard_block();
+                return Indexed::Binary;
+            }
+            first = false;
+            builder.add_text(block);
+            line_count += count_newlines(block) + (block.back() != '\n' ? 1 : 0);
+        }
+        if (source->failed()) {
+            builder.discard_block();
+            return Indexed::Failed;
+        }
+        file.compressed = true;
+        if (not first) {
+            builder.end_block({0, file.size, 1, line_count, number});
+            file.block_count = 1;
+        }
+        builder.files.push_back(std::move(file));
+        return Indexed::Done;
+    }
+
+    Mapping mapping;
+    const bool mapped = mapping.map(fd, file.size);
+    const int error = errno;
+    const std::optional<uint64_t> hash = mapped ? tail_hash(fd, file.size) : std::nullopt;
+    close(fd);
+    if (not mapped or not hash) {
+        errno = mapped ? EIO : error;
+        return Indexed::Failed;
+    }
+
+    const std::string_view text = mapping.text();
+    if (looks_binary(text)) {
+        return Indexed::Binary;
+    }
+    file.tail_hash = *hash;
+    builder.index_text(text, 0, 1, number);
+    file.block_count = static_cast<uint32_t>(builder.blocks.size()) - file.first_block;
+    builder.files.push_back(std::move(file));
+    return Indexed::Done;
+}
+
+// Keeps the blocks of an indexed file, but the last one if it was appended to, whose lines are read
+// again with the new ones
+Indexed reindex_appended(IndexBuilder &builder, const TrigramIndex &old, const TrigramIndex::File &old_file,
+                         const uint32_t number, std::vector<uint32_t> &renumbered) {
+    const int fd = open(old_file.path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return Indexed::Failed;
+    }
+    struct stat info{};
+    Mapping mapping;
+    const bool mapped = fstat(fd, &info) == 0 and mapping.map(fd, info.st_size);
+    const int error = errno;
+    const std::optional<uint64_t> hash = mapped ? tail_hash(fd, info.st_size) : std::nullopt;
+    close(fd);
+    if (not mapped or not hash) {
+        errno = mapped ? EIO : error;
+        return Indexed::Failed;
+    }
+
+    TrigramIndex::File file = old_file;
+    file.size = info.st_size;
+    file.mtime = mtime_of(info);
+    file.tail_hash = *hash;
+    file.first_block = static_cast<uint32_t>(builder.blocks.size());
+
+    uint64_t offset = 0;
+    uint64_t first_line = 1;
+    for (uint32_t block = old_file.first_block; block + 1 < old_file.first_block + old_file.block_count; block++) {
+        renumbered[block] = static_cast<uint32_t>(builder.blocks.size());
+        TrigramIndex::Block kept = old.block(block);
+        kept.file = number;
+        builder.blocks.push_back(kept);
+    }
+    if (old_file.block_count > 0) {
+        const TrigramIndex::Block last = old.block(old_file.first_block + old_file.block_count - 1);
+        offset = last.offset;
+        first_line = last.first_line;
+    }
+
+    builder.index_text(mapping.text(), offset, first_line, number);
+    file.block_count = static_cast<uint32_t>(builder.blocks.size()) - file.first_block;
+    builder.files.push_back(std::move(file));
+    return Indexed::Done;
+}
+
+}
+
+
+std::unique_ptr<TrigramIndex> TrigramIndex::open(const std::string &path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0) {
+        const int error = errno;
+        close(fd);
+        errno = error;
+        return nullptr;
+    }
+    if (static_cast<size_t>(info.st_size) < sizeof(Header)) {
+        close(fd);
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int error = errno;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        errno = error;
+        return nullptr;
+    }
+
+    std::unique_ptr<TrigramIndex> index(new TrigramIndex());
+    index->data = static_cast<const char *>(mapping);
+    index->size = info.st_size;
+
+    // Every offset is checked once here, so lookups can trust them.
+    const auto header = read_record<Header>(index->data);
+    const bool valid_header =
+            std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 and header.size == index->size and
+            header.blocks_offset <= header.trigrams_offset and header.trigrams_offset <= header.postings_offset and
+            header.postings_offset <= header.size and
+            (header.trigrams_offset - header.blocks_offset) / sizeof(BlockRecord) == header.block_count and
+            (header.postings_offset - header.trigrams_offset) / sizeof(TrigramRecord) == header.trigram_count;
+    if (not valid_header) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    index->block_count = header.block_count;
+    index->trigram_count = header.trigram_count;
+    index->blocks_offset = header.blocks_offset;
+    index->trigrams_offset = header.trigrams_offset;
+    index->postings_offset = header.postings_offset;
+
+    size_t position = sizeof(Header);
+    for (uint64_t number = 0; number < header.file_count; number++) {
+        if (header.blocks_offset - position < sizeof(FileRecord)) {
+            errno = EINVAL;
+            return nullptr;
+        }
+        const auto record = read_record<FileRecord>(index->data + position);
+        position += sizeof(FileRecord);
+        if (header.blocks_offset - position < record.path_size or
+            uint64_t{record.first_block} + record.block_count > header.block_count) {
+            errno = EINVAL;
+            return nullptr;
+        }
+        index->files.push_back({std::string(index->data + position, record.path_size), record.size, record.mtime,
+                                record.tail_hash, (record.flags & FILE_COMPRESSED) != 0, record.first_block,
+                                record.block_count});
+        position = std::min<size_t>(padded(position + record.path_size), header.blocks_offset);
+    }
+
+    return index;
+}
+
+TrigramIndex::Block TrigramIndex::block(const size_t number) const {
+    const auto record = read_record<BlockRecord>(data + blocks_offset + number * sizeof(BlockRecord));
+    return {record.offset, record.length, record.first_line, record.line_count, record.file};
+}
+
+// Decodes a posting list, dropping what a corrupt index could place out of range
+static std::vector<uint32_t> decode_postings(const std::string_view encoded, const uint32_t count,
+                                             const size_t block_count) {
+    std::vector<uint32_t> blocks;
+    blocks.reserve(std::min<size_t>(count, block_count));
+    size_t position = 0;
+    uint64_t block = 0;
+    for (uint32_t number = 0; number < count and position < encoded.size(); number++) {
+        uint64_t delta = 0;
+        for (unsigned shift = 0; position < encoded.size() and shift < 35; shift += 7) {
+            const auto byte = static_cast<unsigned char>(encoded[position++]);
+            delta |= uint64_t{byte & 0x7fu} << shift;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+        block += delta;
+        if (block >= block_count) {
+            break;
+        }
+        blocks.push_back(static_cast<uint32_t>(block));
+    }
+    return blocks;
+}
+
+std::vector<uint32_t> TrigramIndex::postings(const uint32_t trigram) const {
+    // Binary search of the sorted table
+    size_t low = 0;
+    size_t high = trigram_count;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        const auto record = read_record<TrigramRecord>(data + trigrams_offset + middle * sizeof(TrigramRecord));
+        if (record.trigram < trigram) {
+            low = middle + 1;
+        } else if (record.trigram > trigram) {
+            high = middle;
+        } else {
+            const std::string_view section(data + postings_offset, size - postings_offset);
+            return decode_postings(section.substr(std::min<size_t>(record.postings, section.size())), record.count,
+                                   block_count);
+        }
+    }
+    return {};
+}
+
+void TrigramIndex::for_each_trigram(
+        const std::function<void(uint32_t trigram, const std::vector<uint32_t> &blocks)> &on_trigram) const {
+    const std::string_view section(data + postings_offset, size - postings_offset);
+    for (size_t number = 0; number < trigram_count; number++) {
+        const auto record = read_record<TrigramRecord>(data + trigrams_offset + number * sizeof(TrigramRecord));
+        on_trigram(record.trigram, decode_postings(section.substr(std::min<size_t>(record.postings, section.size())),
+                                                   record.count, block_count));
+    }
+}
+
+std::optional<std::vector<uint32_t>> TrigramIndex::candidates(const TrigramQuery &query) const {
+    switch (query.kind) {
+        case TrigramQuery::Kind::All:
+            return std::nullopt;
+        case TrigramQuery::Kind::Trigram:
+            return postings(query.trigram);
+        case TrigramQuery::Kind::And: {
+            std::optional<std::vector<uint32_t>> result;
+            for (const auto &child: query.children) {
+                auto blocks = candidates(child);
+                if (not blocks) {
+                    continue;
+                }
+                if (not result) {
+                    result = std::move(blocks);
+                } else {
+                    std::vector<uint32_t> both;
+                    std::set_intersection(result->begin(), result->end(), blocks->begin(), blocks->end(),
+                                          std::back_inserter(both));
+                    *result = std::move(both);
+                }
+                if (result->empty()) {
+                    break;
+                }
+            }
+            return result;
+        }
+        case TrigramQuery::Kind::Or: {
+            std::vector<uint32_t> result;
+            for (const auto &child: query.children) {
+                const auto blocks = candidates(child);
+                if (not blocks) {
+                    return std::nullopt;
+                }
+                std::vector<uint32_t> either;
+                std::set_union(result.begin(), result.end(), blocks->begin(), blocks->end(),
+                               std::back_inserter(either));
+                result = std::move(either);
+            }
+            return result;
+        }
+    }
+    return std::nullopt;
+}
+
+TrigramIndex::Change TrigramIndex::change_of(const File &file) {
+    const int fd = ::open(file.path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return Change::Missing;
+    }
+
+    struct stat info{};
+    Change change = Change::Changed;
+    if (fstat(fd, &info) == 0) {
+        const auto size = static_cast<uint64_t>(info.st_size);
+        if (size == file.size and mtime_of(info) == file.mtime) {
+            change = Change::Unchanged;
+        } else if (size > file.size and not file.compressed and tail_hash(fd, file.size) == file.tail_hash) {
+            change = Change::Appended;
+        }
+    }
+    close(fd);
+    return change;
+}
+
+TrigramIndex::~TrigramIndex() {
+    munmap(const_cast<char *>(data), size);
+}
+
+
+bool update_index(const std::string &path, const std::vector<std::string> &files,
+                  const std::function<void(const std::string &path)> &on_error, IndexUpdate &update) {
+    // Any file already at path must be an index: it is about to be replaced.
+    std::unique_ptr<TrigramIndex> old = TrigramIndex::open(path);
+    if (old == nullptr and errno != ENOENT) {
+        return false;
+    }
+
+    std::unordered_map<std::string_view, const TrigramIndex::File *> old_files;
+    constexpr uint32_t DROPPED = UINT32_MAX;
+    std::vector<uint32_t> renumbered(old != nullptr ? old->blocks() : 0, DROPPED);
+    if (old != nullptr) {
+        for (const auto &file: old->indexed_files()) {
+            old_files.emplace(file.path, &file);
+        }
+    }
+
+    std::vector<std::string> sorted = files;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    IndexBuilder builder;
+    for (const auto &file_path: sorted) {
+        const auto number = static_cast<uint32_t>(builder.files.size());
+        const auto found = old_files.find(file_path);
+        const TrigramIndex::File *old_file = (found != old_files.end()) ? found->second : nullptr;
+        const TrigramIndex::Change change = (old_file != nullptr) ? TrigramIndex::change_of(*old_file)
+                                                                  : TrigramIndex::Change::Changed;
+
+        Indexed indexed;
+        if (change == TrigramIndex::Change::Unchanged) {
+            TrigramIndex::File file = *old_file;
+            file.first_block = static_cast<uint32_t>(builder.blocks.size());
+            for (uint32_t block = 0; block < old_file->block_count; block++) {
+                renumbered[old_file->first_block + block] = static_cast<uint32_t>(builder.blocks.size());
+                TrigramIndex::Block kept = old->block(old_file->first_block + block);
+                kept.file = number;
+                builder.blocks.push_back(kept);
+            }
+            builder.files.push_back(std::move(file));
+            update.unchanged++;
+            continue;
+        } else if (change == TrigramIndex::Change::Appended) {
+            indexed = reindex_appended(builder, *old, *old_file, number, renumbered);
+            update.appended += (indexed == Indexed::Done) ? 1 : 0;
+        } else {
+            indexed = index_file(builder, file_path, number);
+            update.indexed += (indexed == Indexed::Done) ? 1 : 0;
+        }
+
+        if (indexed == Indexed::Binary) {
+            update.skipped++;
+        } else if (indexed == Indexed::Failed) {
+            on_error(file_path);
+        }
+    }
+
+    if (old != nullptr) {
+        builder.merge(*old, renumbered);
+    }
+    const std::string serialized = builder.serialize();
+    old.reset();
+
+    // Written aside and renamed over, so readers see the old index or the new one.
+    const std::string temporary = path + ".tmp";
+    const int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    const bool written = write_all(fd, serialized);
+    const int error = errno;
+    if (close(fd) != 0 or not written or rename(temporary.c_str(), path.c_str()) != 0) {
+        const int final_error = written ? errno : error;
+        unlink(temporary.c_str());
+        errno = final_error;
+        return false;
+    }
+    return true;
+}
+
+
+IndexedSource::IndexedSource(std::string path, std::vector<Range> ranges)
+        : InputSource(std::move(path)), ranges(std::move(ranges)) {}
+
+std::string_view IndexedSource::next_block() {
+    if (next_range == 0 and not ranges.empty() and data == nullptr and not error) {
+        const int fd = open(name.c_str(), O_RDONLY);
+        struct stat info{};
+        if (fd < 0 or fstat(fd, &info) != 0) {
+            const int open_error = errno;
+            if (fd >= 0) {
+                close(fd);
+            }
+            error = true;
+            errno = open_error;
+            return {};
+        }
+        if (info.st_size > 0) {
+            void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                const int map_error = errno;
+                close(fd);
+                error = true;
+                errno = map_error;
+                return {};
+            }
+            // Only some blocks are read: reading ahead past them would be wasted.
+            madvise(mapping, info.st_size, MADV_RANDOM);
+            data = static_cast<const char *>(mapping);
+            size = info.st_size;
+        }
+        close(fd);
+    }
+
+    while (next_range < ranges.size()) {
+        const Range &range = ranges[next_range++];
+        if (range.offset >= size) {
+            continue;
+        }
+
+        const size_t length = std::min<uint64_t>(range.length, size - range.offset);
+        const uintptr_t page = sysconf(_SC_PAGESIZE);
+        const uintptr_t start = reinterpret_cast<uintptr_t>(data + range.offset) & ~(page - 1);
+        madvise(reinterpret_cast<void *>(start), reinterpret_cast<uintptr_t>(data + range.offset) - start + length,
+                MADV_WILLNEED);
+        current_first_line = range.first_line;
+        return {data + range.offset, length};
+    }
+    return {};
+}
+
+IndexedSource::~IndexedSource() {
+    if (data != nullptr) {
+        munmap(const_cast<char *>(data), size);
+    }
+}
@@ -0,0 +1,297 @@
+#include "compressed.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <zlib.h>
+
+#ifdef GREP_ZSTD
+#include <zstd.h>
+#endif
+
+
+namespace {
+    constexpr std::string_view GZIP_MAGIC = "\x1f\x8b";
+    constexpr std::string_view ZSTD_MAGIC = "\x28\xb5\x2f\xfd";
+
+    class GzipDecoder : public Decoder {
+    private:
+        z_stream stream{};
+        bool boundary = true;
+
+    public:
+        GzipDecoder() {
+            // 15 window bits, +32 to accept both gzip and zlib headers
+            inflateInit2(&stream, 15 + 32);
+        }
+
+        GzipDecoder(const GzipDecoder &) = delete;
+        GzipDecoder &operator=(const GzipDecoder &) = delete;
+
+        std::optional<Progress> decode(std::string_view input, char *output, const size_t capacity) override {
+            stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+            stream.avail_in = static_cast<uInt>(std::min<size_t>(input.size(), UINT32_MAX));
+            stream.next_out = reinterpret_cast<Bytef *>(output);
+            stream.avail_out = static_cast<uInt>(std::min<size_t>(capacity, UINT32_MAX));
+
+            while (stream.avail_in > 0 and stream.avail_out > 0) {
+                const int result = inflate(&stream, Z_NO_FLUSH);
+                if (result == Z_STREAM_END) {
+                    // Another gzip member may follow.
+                    boundary = true;
+                    inflateReset(&stream);
+                    continue;
+                }
+                if (result != Z_OK and result != Z_BUF_ERROR) {
+                    return std::nullopt;
+                }
+                boundary = false;
+                if (result == Z_BUF_ERROR) {
+                    break;
+                }
+            }
+
+            return Progress{
+                    static_cast<size_t>(reinterpret_cast<const char *>(stream.next_in) - input.data()),
+                    static_cast<size_t>(reinterpret_cast<char *>(stream.next_out) - output),
+            };
+        }
+
+        [[nodiscard]] bool at_boundary() const override {
+            return boundary;
+        }
+
+        ~GzipDecoder() override {
+            inflateEnd(&stream);
+        }
+    };
+
+#ifdef GREP_ZSTD
+    class ZstdDecoder : public Decoder {
+    private:
+        ZSTD_DCtx *context = ZSTD_createDCtx();
+        bool boundary = true;
+
+    public:
+        ZstdDecoder() = default;
+
+        ZstdDecoder(const ZstdDecoder &) = delete;
+        ZstdDecoder &operator=(const ZstdDecoder &) = delete;
+
+        std::optional<Progress> decode(std::string_view input, char *output, const size_t capacity) override {
+            ZSTD_inBuffer in{input.data(), input.size(), 0};
+            ZSTD_outBuffer out{output, capacity, 0};
+
+            // zstd may have taken all the input and still hold decoded output, so it is called without
+            // input too while a frame is unfinished, until it makes no progress.
+            while (out.pos < out.size and (in.pos < in.size or not boundary)) {
+                const size_t consumed = in.pos;
+                const size_t produced = out.pos;
+                const size_t hint = ZSTD_decompressStream(context, &out, &in);
+                if (ZSTD_isError(hint)) {
+                    return std::nullopt;
+                }
+                // 0 means a frame was fully decoded and flushed; the next one starts afresh.
+                boundary = hint == 0;
+                if (in.pos == consumed and out.pos == produced) {
+                    break;
+                }
+            }
+
+            return Progress{in.pos, out.pos};
+        }
+
+        [[nodiscard]] bool at_boundary() const override {
+            return boundary;
+        }
+
+        ~ZstdDecoder() override {
+            ZSTD_freeDCtx(context);
+        }
+    };
+#endif
+}
+
+
+Compression detect_compression(const std::string_view magic) {
+    if (magic.starts_with(GZIP_MAGIC)) {
+        return Compression::Gzip;
+    }
+    if (magic.starts_with(ZSTD_MAGIC)) {
+        return Compression::Zstd;
+    }
+    return Compression::None;
+}
+
+bool starts_magic(const std::string_view bytes) {
+    return (bytes.size() < GZIP_MAGIC.size() and GZIP_MAGIC.starts_with(bytes))
+           or (bytes.size() < ZSTD_MAGIC.size() and ZSTD_MAGIC.starts_with(bytes));
+}
+
+bool can_decompress(const Compression compression) {
+#ifdef GREP_ZSTD
+    return compression != Compression::None;
+#else
+    return compression == Compression::Gzip;
+#endif
+}
+
+std::unique_ptr<Decoder> Decoder::create(const Compression compression) {
+    switch (compression) {
+        case Compression::Gzip:
+            return std::make_unique<GzipDecoder>();
+#ifdef GREP_ZSTD
+        case Compression::Zstd:
+            return std::make_unique<ZstdDecoder>();
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+
+CompressedSource::CompressedSource(std::string name, const int fd, const bool owns_fd, const Compression compression,
+                                   std::string prefix)
+        : InputSource(std::move(name)), fd(fd), owns_fd(owns_fd), prefix(std::move(prefix)),
+          decoder(Decoder::create(compression)), ring(RING_SIZE) {
+    for (size_t index = 0; index < ring.size(); index++) {
+        ring[index].data.resize(BUFFER_SIZE);
+        free_buffers.push_back(index);
+    }
+
+    decoder_thread = std::thread([this] {
+        decode_all();
+    });
+}
+
+std::optional<size_t> CompressedSource::acquire_free() {
+    std::unique_lock lock(mutex);
+    changed.wait(lock, [&] {
+        return stopping or not free_buffers.empty();
+    });
+    if (stopping) {
+        return std::nullopt;
+    }
+
+    const size_t buffer = free_buffers.front();
+    free_buffers.pop_front();
+    return buffer;
+}
+
+void CompressedSource::publish(const size_t buffer) {
+    std::lock_guard lock(mutex);
+    ready_buffers.push_back(buffer);
+    changed.notify_all();
+}
+
+void CompressedSource::finish(const int error_number) {
+    std::lock_guard lock(mutex);
+    error = error_number;
+    finished = true;
+    changed.notify_all();
+}
+
+void CompressedSource::decode_all() {
+    std::vector<char> raw(READ_SIZE);
+    std::string_view pending = prefix; // read but not decoded yet
+    bool eof = false;
+    bool drained = false; // the input ended and the decoder gave back everything it held
+    std::string carry; // partial line at the end of the last buffer
+
+    while (true) {
+        const std::optional<size_t> index = acquire_free();
+        if (not index) {
+            finish(0);
+            return;
+        }
+        Buffer &buffer = ring[*index];
+        std::memcpy(buffer.data.data(), carry.data(), carry.size());
+        size_t filled = carry.size();
+        carry.clear();
+
+        // Decode until the buffer is full and holds a whole line, or the input ends and the decoder is
+        // drained: it may still hold output once it has taken all the input.
+        size_t scanned = 0;
+        while (not drained) {
+            if (filled == buffer.data.size()) {
+                if (std::memchr(buffer.data.data() + scanned, '\n', filled - scanned) != nullptr) {
+                    break;
+                }
+                scanned = filled;
+                buffer.data.resize(buffer.data.size() * 2);
+            }
+
+            if (pending.empty() and not eof) {
+                const ssize_t count = read(fd, raw.data(), raw.size());
+                if (count < 0 and errno == EINTR) {
+                    continue;
+                }
+                if (count < 0) {
+                    finish(errno);
+                    return;
+                }
+                eof = count == 0;
+                pending = std::string_view(raw.data(), static_cast<size_t>(count));
+            }
+
+            const auto progress = decoder->decode(pending, buffer.data.data() + filled, buffer.data.size() - filled);
+            if (not progress) {
+                finish(EILSEQ);
+                return;
+            }
+            pending.remove_prefix(progress->consumed);
+            filled += progress->produced;
+            drained = eof and progress->produced == 0;
+        }
+
+        if (drained) {
+            buffer.size = filled;
+            if (filled > 0) {
+                publish(*index);
+            }
+            finish(decoder->at_boundary() ? 0 : EILSEQ);
+            return;
+        }
+
+        const auto *last_newline = static_cast<const char *>(memrchr(buffer.data.data(), '\n', filled));
+        buffer.size = last_newline - buffer.data.data() + 1;
+        carry.assign(buffer.data.data() + buffer.size, filled - buffer.size);
+        publish(*index);
+    }
+}
+
+std::string_view CompressedSource::next_block() {
+    std::unique_lock lock(mutex);
+    if (in_use) {
+        free_buffers.push_back(*in_use);
+        in_use.reset();
+        changed.notify_all();
+    }
+
+    changed.wait(lock, [&] {
+        return finished or not ready_buffers.empty();
+    });
+    if (ready_buffers.empty()) {
+        reported_error = error;
+        errno = error;
+        return {};
+    }
+
+    in_use = ready_buffers.front();
+    ready_buffers.pop_front();
+    const Buffer &buffer = ring[*in_use];
+    return {buffer.data.data(), buffer.size};
+}
+
+CompressedSource::~CompressedSource() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+        changed.notify_all();
+    }
+    decoder_thread.join();
+
+    if (owns_fd) {
+        close(fd);
+    }
+}
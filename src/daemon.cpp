@@ -0,0 +1,492 @@
+#include "daemon.hpp"
+
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "PatternCache.hpp"
+#include "ThreadPool.hpp"
+#include "tokenizer.hpp"
+
+
+namespace {
+    constexpr size_t MAX_HEADER_SIZE = 256;
+    constexpr size_t MAX_REQUEST_SIZE = 256 << 20; // pattern and payload together
+    constexpr size_t RECEIVE_SIZE = 64 << 10;
+    constexpr int MAX_EVENTS = 64;
+
+    // epoll keys of the daemon's own descriptors; connections are numbered from FIRST_CONNECTION
+    enum : uint64_t {
+        LISTENER,
+        COMPLETIONS,
+        SIGNALS,
+        FIRST_CONNECTION,
+    };
+
+    struct Request {
+        bool is_file = false;
+        std::string pattern;
+        std::string payload;
+        Options options; // the daemon's, with the request's flags
+    };
+
+    struct Connection {
+        int fd = -1;
+        std::string input;         // received but not parsed yet
+        std::string output;        // responses not written yet
+        size_t written = 0;        // bytes of output already written
+        uint32_t events = EPOLLIN; // registered with epoll
+        bool busy = false;         // a request is being searched
+        bool peer_closed = false;  // the client is done sending
+        bool broken = false;       // a malformed request was answered, close once it is written
+    };
+
+    enum class Parse {
+        Incomplete,
+        Complete,
+        Malformed,
+    };
+
+    std::string response(const int status, const std::string_view body) {
+        return std::to_string(status) + ' ' + std::to_string(body.size()) + '\n' + std::string(body);
+    }
+
+    bool parse_size(const std::string_view text, size_t &size) {
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), size);
+        return error == std::errc() and end == text.data() + text.size() and not text.empty();
+    }
+
+    // Parses the request at the front of input and removes it, or describes the problem in error
+    Parse parse_request(std::string &input, const Options &defaults, Request &request, std::string &error) {
+        const size_t newline = input.find('\n');
+        if (newline == std::string::npos) {
+            if (input.size() > MAX_HEADER_SIZE) {
+                error = "request header too long";
+                return Parse::Malformed;
+            }
+            return Parse::Incomplete;
+        }
+
+        std::vector<std::string_view> words;
+        std::string_view header(input.data(), newline);
+        while (not header.empty()) {
+            const size_t space = std::min(header.find(' '), header.size());
+            if (space > 0) {
+                words.push_back(header.substr(0, space));
+            }
+            header.remove_prefix(std::min(space + 1, header.size()));
+        }
+
+        size_t pattern_size = 0;
+        size_t payload_size = 0;
+        if (words.size() < 3 or words.size() > 4 or not parse_size(words[1], pattern_size) or
+            not parse_size(words[2], payload_size)) {
+            error = "malformed request header";
+            return Parse::Malformed;
+        }
+        if (words[0] != "data" and words[0] != "file") {
+            error = "unknown request '" + std::string(words[0]) + "'";
+            return Parse::Malformed;
+        }
+        if (pattern_size > MAX_REQUEST_SIZE or payload_size > MAX_REQUEST_SIZE - pattern_size) {
+            error = "request too large";
+            return Parse::Malformed;
+        }
+
+        request.options = defaults;
+        for (const char flag: (words.size() == 4) ? words[3] : std::string_view()) {
+            switch (flag) {
+                case 'c':
+                    request.options.count = true;
+                    break;
+                case 'l':
+                    request.options.list_files = true;
+                    break;
+                case 'n':
+                    request.options.line_numbers = true;
+                    break;
+                case 'o':
+                    request.options.only_matching = true;
+                    break;
+                case 'q':
+                    request.options.quiet = true;
+                    break;
+                default:
+                    error = "unknown flag '" + std::string(1, flag) + "'";
+                    return Parse::Malformed;
+            }
+        }
+
+        const size_t size = newline + 1 + pattern_size + payload_size;
+        if (input.size() < size) {
+            return Parse::Incomplete;
+        }
+
+        request.is_file = words[0] == "file";
+        request.pattern = input.substr(newline + 1, pattern_size);
+        request.payload = input.substr(newline + 1 + pattern_size, payload_size);
+        input.erase(0, size);
+        return Parse::Complete;
+    }
+
+    // Whether a socket file is left over from a daemon that is gone
+    bool is_stale(const sockaddr_un &address) {
+        const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe < 0) {
+            return false;
+        }
+        const bool refused = connect(probe, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) < 0 and
+                             errno == ECONNREFUSED;
+        close(probe);
+        return refused;
+    }
+
+    class Daemon {
+    private:
+        const Options &options;
+        const RequestSearch &search;
+        PatternCache cache;
+
+        int listener = -1;
+        int completions = -1; // eventfd signaled by workers after queuing a response
+        int signals = -1;
+        int epoll = -1;
+        bool bound = false;
+
+        std::unordered_map<uint64_t, Connection> connections;
+        uint64_t next_id = FIRST_CONNECTION;
+
+        std::mutex completed_mutex;
+        std::vector<std::pair<uint64_t, std::string>> completed; // responses by connection
+
+        ThreadPool pool;
+
+        // Runs on a worker: searches the request and returns its response
+        std::string answer(const Request &request) {
+            std::shared_ptr<const PatternSet> pattern;
+            try {
+                pattern = cache.get(request.pattern);
+            } catch (const PatternError &error) {
+                return response(2, "invalid pattern: " + std::string(error.what()) + "\n");
+            }
+
+            std::unique_ptr<InputSource> source;
+            if (request.is_file) {
+                source = open_input(request.payload);
+                if (source == nullptr) {
+                    return response(2, request.payload + ": " + std::strerror(errno) + "\n");
+                }
+            } else {
+                source = std::make_unique<MemorySource>("(standard input)", request.payload);
+            }
+
+            std::string output;
+            const int status = search(*pattern, request.options, *source, output);
+            if (source->failed()) {
+                return response(2, source->name + ": " + std::strerror(errno) + "\n");
+            }
+            return response(status, output);
+        }
+
+        void submit(const uint64_t id, Request request) {
+            auto shared = std::make_shared<const Request>(std::move(request));
+            pool.submit([this, id, shared] {
+                std::string reply = answer(*shared);
+                {
+                    std::lock_guard lock(completed_mutex);
+                    completed.emplace_back(id, std::move(reply));
+                }
+                const uint64_t one = 1;
+                [[maybe_unused]] const ssize_t written = write(completions, &one, sizeof(one));
+            });
+        }
+
+        void watch(const int fd, const uint64_t key, const uint32_t events) const {
+            epoll_event event{};
+            event.events = events;
+            event.data.u64 = key;
+            epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+        }
+
+        void close_connection(const uint64_t id) {
+            const auto found = connections.find(id);
+            epoll_ctl(epoll, EPOLL_CTL_DEL, found->second.fd, nullptr);
+            close(found->second.fd);
+            connections.erase(found);
+        }
+
+        void accept_all() {
+            while (true) {
+                const int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) {
+                    if (errno != EAGAIN and errno != EWOULDBLOCK and errno != ECONNABORTED and errno != EINTR) {
+                        std::cerr << "server: accept: " << std::strerror(errno) << std::endl;
+                    }
+                    if (errno == ECONNABORTED or errno == EINTR) {
+                        continue;
+                    }
+                    return;
+                }
+
+                const uint64_t id = next_id++;
+                connections[id].fd = fd;
+                watch(fd, id, EPOLLIN);
+            }
+        }
+
+        // Reads what the client sent; returns false if the connection failed
+        static bool receive(Connection &connection) {
+            while (true) {
+                const size_t size = connection.input.size();
+                connection.input.resize(size + RECEIVE_SIZE);
+                const ssize_t count = recv(connection.fd, connection.input.data() + size, RECEIVE_SIZE, 0);
+                connection.input.resize(size + std::max<ssize_t>(count, 0));
+
+                if (count > 0) {
+                    continue;
+                }
+                if (count == 0) {
+                    connection.peer_closed = true;
+                    return true;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno == EAGAIN or errno == EWOULDBLOCK;
+            }
+        }
+
+        // Writes as much of the pending output as the socket takes; returns false if it failed
+        static bool flush(Connection &connection) {
+            while (connection.written < connection.output.size()) {
+                const ssize_t count = send(connection.fd, connection.output.data() + connection.written,
+                                           connection.output.size() - connection.written, MSG_NOSIGNAL);
+                if (count >= 0) {
+                    connection.written += count;
+                } else if (errno == EAGAIN or errno == EWOULDBLOCK) {
+                    return true;
+                } else if (errno != EINTR) {
+                    return false;
+                }
+            }
+
+            connection.output.clear();
+            connection.written = 0;
+            return true;
+        }
+
+        // Starts the next request of an idle connection, writes what is pending, and closes the
+        // connection once nothing is left to do. Reading stops while a request is being searched, so
+        // a client can't queue unbounded input.
+        void advance(const uint64_t id) {
+            Connection &connection = connections.at(id);
+
+            if (not connection.busy and not connection.broken) {
+                Request request;
+                std::string error;
+                switch (parse_request(connection.input, options, request, error)) {
+                    case Parse::Complete:
+                        connection.busy = true;
+                        submit(id, std::move(request));
+                        break;
+                    case Parse::Malformed:
+                        connection.output += response(2, error + "\n");
+                        connection.broken = true;
+                        break;
+                    case Parse::Incomplete:
+                        break;
+                }
+            }
+
+            if (not flush(connection)) {
+                close_connection(id);
+                return;
+            }
+
+            const bool writing = not connection.output.empty();
+            if (not connection.busy and not writing and (connection.broken or connection.peer_closed)) {
+                close_connection(id);
+                return;
+            }
+
+            uint32_t events = writing ? static_cast<uint32_t>(EPOLLOUT) : 0;
+            if (not connection.busy and not connection.broken and not connection.peer_closed) {
+                events |= EPOLLIN;
+            }
+            if (events != connection.events) {
+                epoll_event event{};
+                event.events = events;
+                event.data.u64 = id;
+                epoll_ctl(epoll, EPOLL_CTL_MOD, connection.fd, &event);
+                connection.events = events;
+            }
+        }
+
+        void on_connection(const uint64_t id, const uint32_t events) {
+            const auto found = connections.find(id);
+            if (found == connections.end()) {
+                return;
+            }
+
+            // The client is gone: nobody is left to answer.
+            if ((events & (EPOLLERR | EPOLLHUP)) != 0 or ((events & EPOLLIN) != 0 and not receive(found->second))) {
+                close_connection(id);
+                return;
+            }
+            advance(id);
+        }
+
+        void collect() {
+            uint64_t count = 0;
+            [[maybe_unused]] const ssize_t read_size = read(completions, &count, sizeof(count));
+
+            std::vector<std::pair<uint64_t, std::string>> responses;
+            {
+                std::lock_guard lock(completed_mutex);
+                responses.swap(completed);
+            }
+
+            for (auto &[id, reply]: responses) {
+                const auto found = connections.find(id);
+                if (found == connections.end()) {
+                    continue;
+                }
+                found->second.output += reply;
+                found->second.busy = false;
+                advance(id);
+            }
+        }
+
+    public:
+        Daemon(const Options &options, const RequestSearch &search)
+                : options(options), search(search), cache(options.pattern_config, options.pattern_cache_size),
+                  pool(options.threads != 0 ? options.threads : std::max(std::thread::hardware_concurrency(), 1u)) {}
+
+        Daemon(const Daemon &) = delete;
+        Daemon &operator=(const Daemon &) = delete;
+
+        // Opens the socket and the descriptors of the event loop; prints the problem and returns false
+        // on failure. SIGINT and SIGTERM must be blocked in every thread.
+        bool start(const sigset_t &stop_signals) {
+            const std::string &path = options.daemon_socket;
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(address.sun_path)) {
+                std::cerr << "server: " << path << ": socket path too long" << std::endl;
+                return false;
+            }
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+            listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (listener < 0) {
+                std::cerr << "server: socket: " << std::strerror(errno) << std::endl;
+                return false;
+            }
+
+            // Only the owner may connect, since requests read files with the daemon's permissions.
+            const mode_t mask = umask(0177);
+            int result = bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+            if (result < 0 and errno == EADDRINUSE and is_stale(address)) {
+                unlink(path.c_str());
+                result = bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+            }
+            umask(mask);
+            if (result < 0 or listen(listener, SOMAXCONN) < 0) {
+                std::cerr << "server: " << path << ": " << std::strerror(errno) << std::endl;
+                return false;
+            }
+            bound = true;
+
+            completions = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            signals = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+            epoll = epoll_create1(EPOLL_CLOEXEC);
+            if (completions < 0 or signals < 0 or epoll < 0) {
+                std::cerr << "server: " << std::strerror(errno) << std::endl;
+                return false;
+            }
+
+            watch(listener, LISTENER, EPOLLIN);
+            watch(completions, COMPLETIONS, EPOLLIN);
+            watch(signals, SIGNALS, EPOLLIN);
+            return true;
+        }
+
+        // Serves until a stop signal arrives; returns false if epoll failed
+        bool run() {
+            epoll_event events[MAX_EVENTS];
+
+            while (true) {
+                const int count = epoll_wait(epoll, events, MAX_EVENTS, -1);
+                if (count < 0 and errno == EINTR) {
+                    continue;
+                }
+                if (count < 0) {
+                    std::cerr << "server: epoll: " << std::strerror(errno) << std::endl;
+                    return false;
+                }
+
+                for (int index = 0; index < count; index++) {
+                    switch (const uint64_t key = events[index].data.u64) {
+                        case LISTENER:
+                            accept_all();
+                            break;
+                        case COMPLETIONS:
+                            collect();
+                            break;
+                        case SIGNALS:
+                            return true;
+                        default:
+                            on_connection(key, events[index].events);
+                    }
+                }
+            }
+        }
+
+        ~Daemon() {
+            // Searches still running write to completions.
+            pool.wait();
+
+            for (const auto &[id, connection]: connections) {
+                close(connection.fd);
+            }
+            for (const int fd: {listener, completions, signals, epoll}) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+            }
+            if (bound) {
+                unlink(options.daemon_socket.c_str());
+            }
+        }
+    };
+}
+
+
+int run_daemon(const Options &options, const RequestSearch &search) {
+    // Blocked before the workers start, so they inherit the mask and the signals reach the signalfd.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+    Daemon daemon(options, search);
+    if (not daemon.start(stop_signals)) {
+        return 2;
+    }
+    return daemon.run() ? 0 : 2;
+}
@@ -0,0 +1,195 @@
+#include "input.hpp"
+
+#include <array>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compressed.hpp"
+
+
+MappedSource::MappedSource(std::string name, const int fd, const size_t size) : InputSource(std::move(name)) {
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return;
+    }
+
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    data = static_cast<const char *>(mapping);
+    this->size = size;
+}
+
+std::string_view MappedSource::next_block() {
+    if (consumed) {
+        return {};
+    }
+
+    consumed = true;
+    return {data, size};
+}
+
+MappedSource::~MappedSource() {
+    if (data != nullptr) {
+        munmap(const_cast<char *>(data), size);
+    }
+}
+
+
+MemorySource::MemorySource(std::string name, const std::string_view text)
+        : InputSource(std::move(name)), text(text) {}
+
+std::string_view MemorySource::next_block() {
+    if (consumed) {
+        return {};
+    }
+
+    consumed = true;
+    return text;
+}
+
+
+StreamSource::StreamSource(std::string name, const int fd, const bool owns_fd, const std::string_view prefix)
+        : InputSource(std::move(name)), fd(fd), owns_fd(owns_fd), buffer(std::max(BUFFER_SIZE, prefix.size())),
+          end(prefix.size()) {
+    std::memcpy(buffer.data(), prefix.data(), prefix.size());
+}
+
+std::string_view StreamSource::next_block() {
+    // 1. Move the partial line left over from the previous block to the front.
+    std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+    end -= begin;
+    begin = 0;
+
+    // 2. Read until the buffer holds at least one complete line or the input ends.
+    size_t scanned = 0;
+    while (not eof and not error) {
+        if (std::memchr(buffer.data() + scanned, '\n', end - scanned) != nullptr) {
+            break;
+        }
+        scanned = end;
+
+        if (end == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+
+        const ssize_t count = read(fd, buffer.data() + end, buffer.size() - end);
+        if (count > 0) {
+            end += count;
+        } else if (count == 0) {
+            eof = true;
+        } else if (errno != EINTR) {
+            error = true;
+        }
+    }
+
+    // 3. Return everything up to the last newline, or the rest of the input once it ended.
+    if (eof or error) {
+        begin = end;
+        return {buffer.data(), end};
+    }
+
+    const auto *last_newline = static_cast<const char *>(memrchr(buffer.data(), '\n', end));
+    begin = last_newline - buffer.data() + 1;
+    return {buffer.data(), begin};
+}
+
+StreamSource::~StreamSource() {
+    if (owns_fd) {
+        close(fd);
+    }
+}
+
+
+// Reads the first bytes of a stream to tell its format. One read is enough unless it returned the start
+// of some magic bytes, so that a pipe or tty holding a single short line is answered without waiting
+// for more input.
+static ssize_t read_magic(const int fd, std::array<char, 4> &magic) {
+    size_t done = 0;
+    while (done < magic.size()) {
+        const ssize_t count = read(fd, magic.data() + done, magic.size() - done);
+        if (count < 0 and errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            return -1;
+        }
+        if (count == 0) {
+            break;
+        }
+        done += count;
+        if (not starts_magic({magic.data(), done})) {
+            break;
+        }
+    }
+    return static_cast<ssize_t>(done);
+}
+
+// Decompresses fd if it starts with the magic bytes of a compression format, maps it if it refers to a
+// non-empty regular file positioned at its start, and otherwise reads it.
+static std::unique_ptr<InputSource> make_source(const std::string &name, const int fd, const bool owns_fd) {
+    std::array<char, 4> magic{};
+    std::string prefix; // bytes consumed from a stream to read the magic
+
+    struct stat info{};
+    const bool mappable = fstat(fd, &info) == 0 and S_ISREG(info.st_mode) and info.st_size > 0 and
+                          lseek(fd, 0, SEEK_CUR) == 0;
+    const ssize_t magic_size = mappable ? pread(fd, magic.data(), magic.size(), 0)
+                                        : read_magic(fd, magic);
+    if (magic_size < 0) {
+        const int error = errno;
+        if (owns_fd) {
+            close(fd);
+        }
+        errno = error;
+        return nullptr;
+    }
+    if (not mappable) {
+        prefix.assign(magic.data(), magic_size);
+    }
+
+    const Compression compression = detect_compression({magic.data(), static_cast<size_t>(magic_size)});
+    if (compression != Compression::None) {
+        if (not can_decompress(compression)) {
+            if (owns_fd) {
+                close(fd);
+            }
+            errno = ENOTSUP;
+            return nullptr;
+        }
+        return std::make_unique<CompressedSource>(name, fd, owns_fd, compression, std::move(prefix));
+    }
+
+    if (mappable) {
+        auto source = std::make_unique<MappedSource>(name, fd, static_cast<size_t>(info.st_size));
+        if (source->mapped()) {
+            if (owns_fd) {
+                close(fd);
+            }
+            return source;
+        }
+    }
+
+    return std::make_unique<StreamSource>(name, fd, owns_fd, prefix);
+}
+
+std::unique_ptr<InputSource> open_input(const std::string &path) {
+    if (path == "-") {
+        return make_source("(standard input)", STDIN_FILENO, false);
+    }
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat info{};
+    if (fstat(fd, &info) == 0 and S_ISDIR(info.st_mode)) {
+        close(fd);
+        errno = EISDIR;
+        return nullptr;
+    }
+
+    return make_source(path, fd, true);
+}
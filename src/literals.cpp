@@ -0,0 +1,144 @@
+#include "literals.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace {
+    // Printable bytes from the most to the least common in English text, source code and logs
+    constexpr std::string_view COMMON_BYTES =
+            " etaoinsrhldcu0mfp1g2wy:b.v,-k3_59487/6=\"')(xTSEIAjCRNOLqDPMz[]HF>B<WU;G{}KV*#JY+Q|&\\X%@$!Z?`~^";
+
+    constexpr std::array<int, 256> make_frequencies() {
+        // Control and non-ASCII bytes are rare, except newlines and tabs.
+        std::array<int, 256> frequencies{};
+        for (size_t rank = 0; rank < COMMON_BYTES.size(); rank++) {
+            frequencies[static_cast<unsigned char>(COMMON_BYTES[rank])] = static_cast<int>(COMMON_BYTES.size() - rank);
+        }
+        frequencies['\t'] = frequencies['e'];
+        frequencies['\n'] = frequencies[' '];
+
+        return frequencies;
+    }
+
+    constexpr std::array<int, 256> FREQUENCIES = make_frequencies();
+
+    int rarest_frequency(const std::string &literal) {
+        int rarest = std::numeric_limits<int>::max();
+        for (const char byte: literal) {
+            rarest = std::min(rarest, byte_frequency(byte));
+        }
+        return rarest;
+    }
+}
+
+
+int byte_frequency(const unsigned char byte) {
+    return FREQUENCIES[byte];
+}
+
+
+std::vector<std::string> RequiredLiterals::finish() {
+    const bool was_exact = exact;
+    break_run();
+    exact = was_exact and literals.size() == 1;
+
+    // Prefer the literal holding the rarest byte, then the longer one.
+    std::ranges::stable_sort(literals, [](const std::string &left, const std::string &right) {
+        const int left_frequency = rarest_frequency(left);
+        const int right_frequency = rarest_frequency(right);
+
+        if (left_frequency != right_frequency) {
+            return left_frequency < right_frequency;
+        }
+        return left.size() > right.size();
+    });
+
+    return literals;
+}
+
+
+LiteralSearcher::LiteralSearcher(std::string _needle) : needle(std::move(_needle)) {
+    auto frequency_at = [&](const size_t offset) {
+        return byte_frequency(needle[offset]);
+    };
+
+    for (size_t offset = 1; offset < needle.size(); offset++) {
+        if (frequency_at(offset) < frequency_at(rare_first)) {
+            rare_first = offset;
+        }
+    }
+
+    rare_second = (rare_first == 0 and needle.size() > 1) ? 1 : 0;
+    for (size_t offset = 0; offset < needle.size(); offset++) {
+        if (offset != rare_first and frequency_at(offset) < frequency_at(rare_second)) {
+            rare_second = offset;
+        }
+    }
+}
+
+size_t LiteralSearcher::find(std::string_view haystack, const size_t from) const {
+    const size_t length = needle.size();
+    if (length == 0) {
+        return from <= haystack.size() ? from : std::string_view::npos;
+    }
+    if (haystack.size() < length or from > haystack.size() - length) {
+        return std::string_view::npos;
+    }
+
+    const char *begin = haystack.data();
+    const char *last = begin + haystack.size() - length; // last possible start of a match
+    const char *start = begin + from;
+
+    auto verify = [&](const char *candidate) {
+        return std::memcmp(candidate, needle.data(), length) == 0;
+    };
+
+#ifdef __SSE2__
+    // Compare 16 candidate starts at once on the two rarest bytes.
+    if (length > 1) {
+        const __m128i first = _mm_set1_epi8(needle[rare_first]);
+        const __m128i second = _mm_set1_epi8(needle[rare_second]);
+
+        while (start + 15 <= last) {
+            const __m128i first_bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(start + rare_first));
+            const __m128i second_bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(start + rare_second));
+            auto mask = static_cast<unsigned>(_mm_movemask_epi8(
+                    _mm_and_si128(_mm_cmpeq_epi8(first_bytes, first), _mm_cmpeq_epi8(second_bytes, second))));
+
+            while (mask != 0) {
+                const char *candidate = start + __builtin_ctz(mask);
+                if (verify(candidate)) {
+                    return candidate - begin;
+                }
+                mask &= mask - 1;
+            }
+
+            start += 16;
+        }
+    }
+#endif
+
+    // memchr is vectorized by the C library; verify each position of the rarest byte.
+    while (start <= last) {
+        const auto *found = static_cast<const char *>(
+                std::memchr(start + rare_first, needle[rare_first], last - start + 1));
+        if (found == nullptr) {
+            break;
+        }
+
+        const char *candidate = found - rare_first;
+        if (verify(candidate)) {
+            return candidate - begin;
+        }
+        start = candidate + 1;
+    }
+
+    return std::string_view::npos;
+}
@@ -0,0 +1,218 @@
+#include "options.hpp"
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+
+#include "input.hpp"
+
+
+// Parses a byte count with an optional K, M or G suffix
+static bool parse_size(const std::string_view text, size_t &size) {
+    size_t value = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() or end == text.data()) {
+        return false;
+    }
+
+    const std::string_view suffix(end, text.data() + text.size() - end);
+    if (suffix == "K") {
+        value <<= 10;
+    } else if (suffix == "M") {
+        value <<= 20;
+    } else if (suffix == "G") {
+        value <<= 30;
+    } else if (not suffix.empty()) {
+        return false;
+    }
+
+    size = value;
+    return true;
+}
+
+// Appends one pattern per line of the file ("-" is stdin)
+static bool read_patterns(const std::string &path, std::vector<std::string> &patterns) {
+    const auto source = open_input(path);
+    if (source == nullptr) {
+        std::cerr << "server: " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    for (auto block = source->next_block(); not block.empty(); block = source->next_block()) {
+        for_each_line(block, [&](std::string_view line) {
+            patterns.emplace_back(line);
+            return true;
+        });
+    }
+
+    if (source->failed()) {
+        std::cerr << "server: " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Parses a positive decimal count
+static bool parse_count(const std::string_view text, size_t &count) {
+    size_t value = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() or end != text.data() + text.size() or value == 0) {
+        return false;
+    }
+
+    count = value;
+    return true;
+}
+
+bool parse_options(const int argc, char *argv[], Options &options) {
+    bool has_pattern = false;
+
+    for (int index = 1; index < argc; index++) {
+        const std::string_view argument = argv[index];
+
+        if (argument == "-E" or argument == "-e") {
+            if (index + 1 == argc) {
+                std::cerr << "Expected a pattern after '" << argument << "'" << std::endl;
+                return false;
+            }
+            options.patterns.emplace_back(argv[++index]);
+            has_pattern = true;
+        } else if (argument == "-f") {
+            if (index + 1 == argc) {
+                std::cerr << "Expected a file of patterns after '-f'" << std::endl;
+                return false;
+            }
+            if (not read_patterns(argv[++index], options.patterns)) {
+                return false;
+            }
+            has_pattern = true;
+        } else if (argument.starts_with("--engine=")) {
+            const std::string_view name = argument.substr(argument.find('=') + 1);
+            if (name == "auto") {
+                options.pattern_config.engine = Engine::Auto;
+            } else if (name == "tree") {
+                options.pattern_config.engine = Engine::Tree;
+            } else if (name == "backtrack") {
+                options.pattern_config.engine = Engine::Backtrack;
+            } else if (name == "pike") {
+                options.pattern_config.engine = Engine::PikeVM;
+            } else if (name == "dfa") {
+                options.pattern_config.engine = Engine::DFA;
+            } else {
+                std::cerr << "Unknown engine '" << name << "'" << std::endl;
+                return false;
+            }
+        } else if (argument.starts_with("--dfa-cache=")) {
+            if (not parse_size(argument.substr(argument.find('=') + 1), options.pattern_config.dfa_memory_limit)) {
+                std::cerr << "Expected a size in bytes in '" << argument << "'" << std::endl;
+                return false;
+            }
+        } else if (argument.starts_with("--chunk-size=")) {
+            if (not parse_size(argument.substr(argument.find('=') + 1), options.chunk_size) or options.chunk_size == 0) {
+                std::cerr << "Expected a size in bytes in '" << argument << "'" << std::endl;
+                return false;
+            }
+        } else if (argument.starts_with("--step-budget=")) {
+            if (not parse_size(argument.substr(argument.find('=') + 1), options.pattern_config.step_budget)) {
+                std::cerr << "Expected a step count in '" << argument << "'" << std::endl;
+                return false;
+            }
+        } else if (argument.starts_with("--match-memory=")) {
+            if (not parse_size(argument.substr(argument.find('=') + 1), options.pattern_config.match_memory_limit)) {
+                std::cerr << "Expected a size in bytes in '" << argument << "'" << std::endl;
+                return false;
+            }
+        } else if (argument == "-q") {
+            options.quiet = true;
+        } else if (argument == "-l") {
+            options.list_files = true;
+        } else if (argument == "-c") {
+            options.count = true;
+        } else if (argument == "-o") {
+            options.only_matching = true;
+        } else if (argument == "-n") {
+            options.line_numbers = true;
+        } else if (argument == "-r") {
+            options.recursive = true;
+        } else if (argument == "-j") {
+            if (index + 1 == argc or not parse_count(argv[index + 1], options.threads)) {
+                std::cerr << "Expected a thread count after '-j'" << std::endl;
+                return false;
+            }
+            index++;
+        } else if (argument == "--no-memo") {
+            options.pattern_config.memoize = false;
+        } else if (argument == "--no-prefilter") {
+            options.pattern_config.prefilter = false;
+        } else if (argument == "--stats" or argument.starts_with("--stats=")) {
+            options.stats = true;
+            if (argument.starts_with("--stats=")) {
+                options.stats_path = argument.substr(argument.find('=') + 1);
+            }
+        } else if (argument.starts_with("--daemon=")) {
+            options.daemon_socket = argument.substr(argument.find('=') + 1);
+            if (options.daemon_socket.empty()) {
+                std::cerr << "Expected a socket path in '" << argument << "'" << std::endl;
+                return false;
+            }
+        } else if (argument.starts_with("--pattern-cache=")) {
+            if (not parse_count(argument.substr(argument.find('=') + 1), options.pattern_cache_size)) {
+                std::cerr << "Expected a pattern count in '" << argument << "'" << std::endl;
+                return false;
+            }
+        } else if (argument.starts_with("--index=") or argument.starts_with("--build-index=")) {
+            options.index_path = argument.substr(argument.find('=') + 1);
+            options.build_index = argument.starts_with("--build-index=");
+            if (options.index_path.empty()) {
+                std::cerr << "Expected an index path in '" << argument << "'" << std::endl;
+                return false;
+            }
+        } else if (argument == "--debug") {
+            options.debug = true;
+        } else if (argument.size() > 1 and argument.front() == '-') {
+            std::cerr << "Unknown option '" << argument << "'" << std::endl;
+            return false;
+        } else {
+            options.files.emplace_back(argument);
+        }
+    }
+
+    // The daemon takes its patterns and inputs from requests.
+    if (not options.daemon_socket.empty()) {
+        if (has_pattern or not options.files.empty()) {
+            std::cerr << "'--daemon' takes patterns and files from its requests only" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Indexing reads the operands, the working directory by default; searching reads the index.
+    if (options.build_index) {
+        if (has_pattern) {
+            std::cerr << "'--build-index' takes no pattern" << std::endl;
+            return false;
+        }
+        if (options.files.empty()) {
+            options.files.emplace_back(".");
+        }
+        return true;
+    }
+    if (not options.index_path.empty() and not options.files.empty()) {
+        std::cerr << "'--index' searches the indexed files and takes no file operands" << std::endl;
+        return false;
+    }
+
+    if (not has_pattern) {
+        std::cerr << "Expected a pattern: '-E pattern', '-e pattern' or '-f file'" << std::endl;
+        return false;
+    }
+
+    // With no file operands the input is stdin, or the working directory when recursive, like grep.
+    if (options.files.empty() and options.index_path.empty()) {
+        options.files.emplace_back(options.recursive ? "." : "-");
+    }
+
+    return true;
+}
@@ -0,0 +1,36 @@
+#include "output.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+void BufferedWriter::write_through(std::string_view text) {
+    std::string_view buffered(buffer.data(), used);
+    used = 0;
+
+    while (not error and not (buffered.empty() and text.empty())) {
+        iovec pieces[2] = {
+                {const_cast<char *>(buffered.data()), buffered.size()},
+                {const_cast<char *>(text.data()), text.size()},
+        };
+        const ssize_t written = writev(fd, pieces, 2);
+        if (written < 0) {
+            error = errno != EINTR;
+            continue;
+        }
+
+        // Partial writes consume the buffered bytes first.
+        const size_t from_buffer = std::min(static_cast<size_t>(written), buffered.size());
+        buffered.remove_prefix(from_buffer);
+        text.remove_prefix(static_cast<size_t>(written) - from_buffer);
+    }
+}
+
+bool BufferedWriter::flush() {
+    if (used > 0) {
+        write_through({});
+    }
+    return not error;
+}
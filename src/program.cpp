@@ -0,0 +1,103 @@
+#include "program.hpp"
+
+
+void ProgramBuilder::emit_byte_set(const ByteClass &bytes) {
+    if (bytes.all()) {
+        emit({Opcode::Any});
+    } else if (bytes.count() == 1) {
+        int byte = 0;
+        while (not bytes[byte]) {
+            byte++;
+        }
+        emit({Opcode::Char, static_cast<char>(byte)});
+    } else {
+        program.classes.push_back(bytes);
+        emit({Opcode::Class, 0, static_cast<int>(program.classes.size()) - 1});
+    }
+}
+
+Program ProgramBuilder::finish() {
+    emit({Opcode::Match});
+
+    // The loop slots follow the captures, whose count is only known now.
+    for (const auto &[save, loop]: loops) {
+        const int slot = program.slot_count() + program.loop_count++;
+        program.instructions[save].argument = slot;
+        program.instructions[loop].alternative = slot;
+    }
+
+    size_t pc = 0;
+    while (program.instructions[pc].opcode == Opcode::Save or program.instructions[pc].opcode == Opcode::AtomicBegin) {
+        pc++;
+    }
+    program.anchored = program.instructions[pc].opcode == Opcode::AssertBegin;
+
+    return std::move(program);
+}
+
+
+Program compile_program(const Token &root) {
+    ProgramBuilder builder;
+
+    // The root is group 0, so its saves mark the whole match.
+    root.compile(builder);
+
+    return builder.finish();
+}
+
+
+std::string Program::to_string() const {
+    std::string str;
+
+    for (size_t pc = 0; pc < instructions.size(); pc++) {
+        const auto &[opcode, literal, argument, alternative] = instructions[pc];
+        str += std::to_string(pc) + ": ";
+
+        switch (opcode) {
+            case Opcode::Char:
+                str += "char '" + std::string(1, literal) + "'";
+                break;
+            case Opcode::Class:
+                str += "class " + std::to_string(argument) + " (" + std::to_string(classes[argument].count()) + " bytes)";
+                break;
+            case Opcode::Any:
+                str += "any";
+                break;
+            case Opcode::Split:
+                str += "split " + std::to_string(argument) + ", " + std::to_string(alternative);
+                break;
+            case Opcode::Jump:
+                str += "jump " + std::to_string(argument);
+                break;
+            case Opcode::Save:
+                str += "save " + std::to_string(argument);
+                break;
+            case Opcode::AssertBegin:
+                str += "assert begin";
+                break;
+            case Opcode::AssertEnd:
+                str += "assert end";
+                break;
+            case Opcode::Backref:
+                str += "backref " + std::to_string(argument);
+                break;
+            case Opcode::Loop:
+                str += "loop " + std::to_string(argument) + ", " + std::to_string(pc + 1) + " unless empty since slot "
+                       + std::to_string(alternative);
+                break;
+            case Opcode::AtomicBegin:
+                str += argument != 0 ? "atomic begin" : "atomic begin (implied)";
+                break;
+            case Opcode::AtomicEnd:
+                str += "atomic end";
+                break;
+            case Opcode::Match:
+                str += "match";
+                break;
+        }
+
+        str += '\n';
+    }
+
+    return str;
+}
@@ -0,0 +1,151 @@
+#include "stats.hpp"
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <vector>
+
+#include "input.hpp"
+
+
+namespace {
+    struct Totals {
+        std::array<uint64_t, static_cast<size_t>(StatCounter::Count)> counters{};
+        std::array<uint64_t, static_cast<size_t>(StatGauge::Count)> gauges{};
+        std::array<std::chrono::steady_clock::duration, static_cast<size_t>(StatPhase::Count)> phases{};
+
+        void merge(const Totals &other) {
+            for (size_t index = 0; index < counters.size(); index++) {
+                counters[index] += other.counters[index];
+            }
+            for (size_t index = 0; index < gauges.size(); index++) {
+                gauges[index] = std::max(gauges[index], other.gauges[index]);
+            }
+            for (size_t index = 0; index < phases.size(); index++) {
+                phases[index] += other.phases[index];
+            }
+        }
+    };
+
+    struct ThreadTotals;
+
+    // Totals of the running threads, and of those that exited
+    std::mutex registry_mutex;
+    std::vector<const ThreadTotals *> live;
+    Totals retired;
+
+    // Counted without synchronization by its thread and read by stats_json() once the work is done
+    struct ThreadTotals : Totals {
+        ThreadTotals() {
+            std::lock_guard lock(registry_mutex);
+            live.push_back(this);
+        }
+
+        ~ThreadTotals() {
+            std::lock_guard lock(registry_mutex);
+            retired.merge(*this);
+            std::erase(live, this);
+        }
+    };
+
+    Totals &totals() {
+        thread_local ThreadTotals thread_totals;
+        return thread_totals;
+    }
+
+    const char *const COUNTER_NAMES[] = {
+            "bytes_read", "lines_read", "engine_calls", "start_positions", "Level", "Alternation", "OneOrMore",
+            "ZeroOrOne", "Repeat", "Atomic", "Literal", "ByteClass", "Anchor", "Backref", "backreference_copies",
+            "backtrack_steps", "atomic_discards", "dfa_states", "dfa_fallbacks", "budget_fallbacks", "budget_exceeded",
+    };
+    static_assert(std::size(COUNTER_NAMES) == static_cast<size_t>(StatCounter::Count));
+
+    const char *const GAUGE_NAMES[] = {"max_recursion_depth", "max_backtrack_stack"};
+    static_assert(std::size(GAUGE_NAMES) == static_cast<size_t>(StatGauge::Count));
+
+    const char *const PHASE_NAMES[] = {"compile", "io", "match"};
+    static_assert(std::size(PHASE_NAMES) == static_cast<size_t>(StatPhase::Count));
+}
+
+
+void add_stat(const StatCounter counter, const uint64_t amount) {
+    totals().counters[static_cast<size_t>(counter)] += amount;
+}
+
+#ifdef GREP_STATS
+void raise_stat(const StatGauge gauge, const uint64_t value) {
+    if (stats_enabled) {
+        uint64_t &maximum = totals().gauges[static_cast<size_t>(gauge)];
+        maximum = std::max(maximum, value);
+    }
+}
+#endif
+
+void add_phase_time(const StatPhase phase, const std::chrono::steady_clock::duration time) {
+    totals().phases[static_cast<size_t>(phase)] += time;
+}
+
+void count_input(const std::string_view block) {
+    if (stats_enabled) {
+        add_stat(StatCounter::BytesRead, block.size());
+        add_stat(StatCounter::LinesRead, count_newlines(block));
+    }
+}
+
+std::string stats_json() {
+    Totals sum;
+    {
+        std::lock_guard lock(registry_mutex);
+        sum = retired;
+        for (const ThreadTotals *thread_totals: live) {
+            sum.merge(*thread_totals);
+        }
+    }
+
+    auto counter = [&](const StatCounter index) {
+        return "\"" + std::string(COUNTER_NAMES[static_cast<size_t>(index)]) + "\": "
+               + std::to_string(sum.counters[static_cast<size_t>(index)]);
+    };
+
+    std::string json = "{\n";
+    for (const auto index: {StatCounter::BytesRead, StatCounter::LinesRead}) {
+        json += "  " + counter(index) + ",\n";
+    }
+
+    json += "  \"seconds\": {";
+    for (size_t phase = 0; phase < sum.phases.size(); phase++) {
+        const double seconds = std::chrono::duration<double>(sum.phases[phase]).count();
+        json += std::string(phase == 0 ? "" : ", ") + "\"" + PHASE_NAMES[phase] + "\": " + std::to_string(seconds);
+    }
+    json += "}";
+
+    // Counters of the matchers, only kept by builds with GREP_STATS
+    if (MATCHER_STATS_ENABLED) {
+        json += ",\n";
+        for (const auto index: {StatCounter::EngineCalls, StatCounter::StartPositions}) {
+            json += "  " + counter(index) + ",\n";
+        }
+
+        json += "  \"get_matches\": {";
+        for (auto index = static_cast<size_t>(StatCounter::LevelCalls); index <= static_cast<size_t>(StatCounter::BackrefCalls); index++) {
+            json += std::string(index == static_cast<size_t>(StatCounter::LevelCalls) ? "" : ", ")
+                    + counter(static_cast<StatCounter>(index));
+        }
+        json += "},\n";
+
+        for (size_t gauge = 0; gauge < sum.gauges.size(); gauge++) {
+            json += "  \"" + std::string(GAUGE_NAMES[gauge]) + "\": " + std::to_string(sum.gauges[gauge]) + ",\n";
+        }
+        for (const auto index: {StatCounter::BackreferenceCopies, StatCounter::BacktrackSteps,
+                                StatCounter::AtomicDiscards}) {
+            json += "  " + counter(index) + ",\n";
+        }
+
+        for (const auto index: {StatCounter::DfaStates, StatCounter::DfaFallbacks, StatCounter::BudgetFallbacks,
+                                StatCounter::BudgetExceeded}) {
+            json += "  " + counter(index) + (index == StatCounter::BudgetExceeded ? "" : ",\n");
+        }
+    }
+
+    return json + "\n}\n";
+}
@@ -1,112 +1,311 @@
 #include "tokenizer.hpp"
 
+#include <algorithm>
+#include <utility>
+#include <vector>
 
-int get_matched(TokenizerStack &tokenizer_stack, const std::string& text, const int id) {
-    int offset = 1;
-    std::smatch match;
 
-    // Helper function for matching a pattern and performing an action
-    auto match_and_act = [&](const std::regex& regex_pattern, auto action) {
-        if (std::regex_search(text, match, regex_pattern)) {
-            action();
-            return true;
+namespace {
+    // Recursive-descent parser over the grammar
+    //   branches   := sequence ('|' sequence)*
+    //   sequence   := (atom quantifier*)*
+    //   quantifier := ('+' | '?' | '*' | '{' count (',' count?)? '}') '+'?
+    //   atom       := '(' '?>'? branches ')' | '[' '^'? member* ']' | '.' | '^' | '$' | '\' byte | byte
+    // where a '+' right after a quantifier makes it possessive, and a '{' not starting a quantifier is a
+    // literal byte.
+    class Parser {
+    private:
+        static constexpr int MAX_GROUP = 1 << 20;
+        static constexpr size_t MAX_COMPILED_SIZE = 1 << 20; // instructions, with the repetitions expanded
+
+        std::string_view pattern;
+        size_t offset = 0;
+        int next_index = 0;
+        int group_count = 0;
+        std::vector<std::pair<int, size_t>> backrefs; // group referenced and offset of the reference
+
+        [[nodiscard]] bool at_end() const {
+            return offset == pattern.size();
         }
-        return false;
-    };
 
-    // Helper to add tokens and push to the stack if needed
-    auto add_token = [&](auto token_ptr, bool push_to_stack = false, bool is_alternative = false) {
-        tokenizer_stack.add_token(token_ptr);
-        if (push_to_stack) {
-            tokenizer_stack.stack_push(is_alternative);
+        [[nodiscard]] char peek() const {
+            return pattern[offset];
         }
-    };
 
-    // Check and perform actions based on matched patterns
-    if (match_and_act(patterns::WILDCARD, [&]() {
-        add_token(std::make_shared<Wildcard>(id));
-        })) return offset;
-
-    if (match_and_act(patterns::BEGIN, [&]() {
-        add_token(std::make_shared<BeginAnchor>(id));
-        })) return offset;
-
-    if (match_and_act(patterns::END, [&]() {
-        add_token(std::make_shared<EndAnchor>(id));
-        })) return offset;
-
-    if (match_and_act(patterns::ONE_OR_MORE, [&]() {
-        tokenizer_stack.assign_previous(std::make_shared<OneOrMore>(id));
-        })) return offset;
-
-    if (match_and_act(patterns::ZERO_OR_ONE, [&]() {
-        tokenizer_stack.assign_previous(std::make_shared<ZeroOrOne>(id));
-        })) return offset;
-
-    if (match_and_act(patterns::DIGIT, [&]() {
-        add_token(std::make_shared<Digit>(id));
-        offset = 2;
-        })) return offset;
-
-    if (match_and_act(patterns::ALNUM, [&]() {
-        add_token(std::make_shared<Alnum>(id));
-        offset = 2;
-        })) return offset;
-
-    if (match_and_act(patterns::BACKREFERENCE, [&]() {
-        auto backref_index_str = match[0].str().substr(1);
-        int backref_index = std::stoi(backref_index_str) + 1;
-        add_token(std::make_shared<Backref>(id, backref_index));
-        offset = static_cast<int>(backref_index_str.size()) + 1;
-        })) return offset;
-
-    if (match_and_act(patterns::NEGATIVE_GROUP, [&]() {
-        add_token(std::make_shared<NegativeCharacterGroup>(id), true);
-        offset = 2;
-        })) return offset;
-
-    if (match_and_act(patterns::POSITIVE_GROUP, [&]() {
-        add_token(std::make_shared<PositiveCharacterGroup>(id), true);
-        })) return offset;
-
-    if (match_and_act(patterns::END_GROUP, [&]() {
-        tokenizer_stack.assign_group();
-        })) return offset;
-
-    if (match_and_act(patterns::ALTERNATIVE, [&]() {
-        add_token(std::make_shared<Alternation>(id), true, true);
-        add_token(std::make_shared<Level>(id), true);
-        })) return offset;
-
-    if (match_and_act(patterns::ALTERNATION, [&]() {
-        tokenizer_stack.assign_group();
-        tokenizer_stack.assign_level();
-        add_token(std::make_shared<Level>(id), true);
-        })) return offset;
-
-    if (match_and_act(patterns::BEGIN_LEVEL, [&]() {
-        add_token(std::make_shared<Level>(id), true);
-        })) return offset;
-
-    if (match_and_act(patterns::END_LEVEL, [&]() {
-        tokenizer_stack.assign_group();
-        tokenizer_stack.handle_alternation_group();
-        })) return offset;
-
-    // Default case: Add a literal token
-    tokenizer_stack.add_token(std::make_shared<Literal>(id, text[0]));
-    return offset;
-}
+        template <typename TokenType, typename... Arguments>
+        std::shared_ptr<TokenType> make(Arguments... arguments) {
+            return std::make_shared<TokenType>(next_index++, arguments...);
+        }
 
-std::shared_ptr<Token> tokenize(const std::string& input) {
-    auto tokenizer_stack = TokenizerStack();
-    int id = 0;
+        std::vector<std::shared_ptr<Token>> parse_branches() {
+            std::vector<std::shared_ptr<Token>> branches{parse_sequence()};
+
+            while (not at_end() and peek() == '|') {
+                offset++;
+                branches.push_back(parse_sequence());
+            }
+
+            return branches;
+        }
+
+        // Tokens up to the next '|', ')' or the end of the pattern
+        std::shared_ptr<Level> parse_sequence() {
+            auto level = make<Level>();
+
+            while (not at_end() and peek() != '|' and peek() != ')') {
+                if (const size_t start = offset; parse_quantifier() != nullptr) {
+                    throw PatternError("nothing to repeat", pattern, start);
+                }
+
+                auto token = parse_atom();
+                for (size_t start = offset; not at_end(); start = offset) {
+                    auto repetition = parse_quantifier();
+                    if (repetition == nullptr) {
+                        break;
+                    }
+                    repetition->children.push_back(std::move(token));
+                    token = std::move(repetition);
+
+                    if (not at_end() and peek() == '+') {
+                        auto atomic = make<Atomic>();
+                        atomic->children.push_back(std::move(token));
+                        token = std::move(atomic);
+                        offset++;
+                    }
 
-    for (size_t index = 0; index < input.size(); id++) {
-        index += get_matched(tokenizer_stack, input.substr(index), id);
-    }
+                    // Every repetition of '{n,m}' is compiled, so nesting them multiplies the program.
+                    if (compiled_size(*token) > MAX_COMPILED_SIZE) {
+                        throw PatternError("repetition too large", pattern, start);
+                    }
+                }
+
+                level->children.push_back(std::move(token));
+            }
+
+            return level;
+        }
+
+        // The repetition for the quantifier at the offset, consumed, or null if there is none
+        std::shared_ptr<Token> parse_quantifier() {
+            switch (peek()) {
+                case '+':
+                    offset++;
+                    return make<OneOrMore>();
+                case '?':
+                    offset++;
+                    return make<ZeroOrOne>();
+                case '*':
+                    offset++;
+                    return make<Repeat>(0, -1);
+                case '{':
+                    return parse_bounds();
+                default:
+                    return nullptr;
+            }
+        }
+
+        // '{n}', '{n,}' or '{n,m}'; anything else leaves the '{' to be read as a literal
+        std::shared_ptr<Token> parse_bounds() {
+            size_t end = offset + 1;
+            // Counts past MAX_COUNT are invalid anyway; capping them avoids overflowing.
+            auto count = [&](int &value) {
+                const size_t first = end;
+                value = 0;
+                while (end < pattern.size() and pattern[end] >= '0' and pattern[end] <= '9') {
+                    value = std::min(value * 10 + (pattern[end++] - '0'), Repeat::MAX_COUNT + 1);
+                }
+                return end > first;
+            };
+
+            int min;
+            int max;
+            if (not count(min)) {
+                return nullptr;
+            }
+            if (end < pattern.size() and pattern[end] == ',') {
+                end++;
+                if (not count(max)) {
+                    max = -1;
+                }
+            } else {
+                max = min;
+            }
+            if (end == pattern.size() or pattern[end] != '}') {
+                return nullptr;
+            }
+
+            if (min > Repeat::MAX_COUNT or max > Repeat::MAX_COUNT) {
+                throw PatternError("repetition count too large", pattern, offset);
+            }
+            if (max >= 0 and min > max) {
+                throw PatternError("invalid repetition bounds", pattern, offset);
+            }
+            offset = end + 1;
+            return make<Repeat>(min, max);
+        }
+
+        // Instructions the token compiles to, roughly
+        static size_t compiled_size(const Token &token) {
+            size_t size = 1;
+            for (const auto &child: token.children) {
+                size += compiled_size(*child);
+            }
+            if (const auto *repeat = dynamic_cast<const Repeat *>(&token)) {
+                size *= static_cast<size_t>(std::max({repeat->min, repeat->max, 1}));
+            }
+            return size;
+        }
+
+        std::shared_ptr<Token> parse_atom() {
+            const size_t start = offset++;
+
+            switch (pattern[start]) {
+                case '(':
+                    return parse_group(start);
+                case '[':
+                    return parse_class(start);
+                case '.':
+                    return make<Wildcard>();
+                case '^':
+                    return make<BeginAnchor>();
+                case '$':
+                    return make<EndAnchor>();
+                case '\\':
+                    return parse_escape(start);
+                default:
+                    return make<Literal>(pattern[start]);
+            }
+        }
 
-    auto root = std::make_shared<Level>(id);
-    root->children = tokenizer_stack.tokens;
-    return root;
+        // A group with alternatives becomes an Alternation of branch Levels, otherwise a single Level. An
+        // atomic group captures nothing, and wraps them in an Atomic.
+        std::shared_ptr<Token> parse_group(const size_t start) {
+            const bool atomic = pattern.substr(offset).starts_with("?>");
+            if (atomic) {
+                offset += 2;
+            } else {
+                group_count++;
+            }
+
+            auto branches = parse_branches();
+            if (at_end()) {
+                throw PatternError("unmatched '('", pattern, start);
+            }
+            offset++;
+
+            std::shared_ptr<Token> group;
+            if (branches.size() == 1) {
+                group = branches.front();
+            } else {
+                group = make<Alternation>(not atomic);
+                group->children = std::move(branches);
+            }
+            if (not atomic) {
+                return group;
+            }
+
+            auto atomic_group = make<Atomic>();
+            atomic_group->children.push_back(std::move(group));
+            return atomic_group;
+        }
+
+        // Members are literal bytes, \d and \w; any other escaped byte stands for itself.
+        std::shared_ptr<Token> parse_class(const size_t start) {
+            std::shared_ptr<Token> group;
+            if (not at_end() and peek() == '^') {
+                group = make<NegativeCharacterGroup>();
+                offset++;
+            } else {
+                group = make<PositiveCharacterGroup>();
+            }
+
+            while (not at_end() and peek() != ']') {
+                if (peek() == '\\' and offset + 1 < pattern.size()) {
+                    const char escaped = pattern[offset + 1];
+                    offset += 2;
+
+                    if (escaped == 'd') {
+                        group->children.push_back(make<Digit>());
+                    } else if (escaped == 'w') {
+                        group->children.push_back(make<Alnum>());
+                    } else {
+                        group->children.push_back(make<Literal>(escaped));
+                    }
+                } else {
+                    group->children.push_back(make<Literal>(pattern[offset++]));
+                }
+            }
+
+            if (at_end()) {
+                throw PatternError("unterminated character class", pattern, start);
+            }
+            offset++;
+
+            return group;
+        }
+
+        std::shared_ptr<Token> parse_escape(const size_t start) {
+            if (at_end()) {
+                throw PatternError("trailing backslash", pattern, start);
+            }
+
+            const char escaped = pattern[offset++];
+            if (escaped == 'd') {
+                return make<Digit>();
+            }
+            if (escaped == 'w') {
+                return make<Alnum>();
+            }
+            if (escaped < '0' or escaped > '9') {
+                return make<Literal>(escaped);
+            }
+
+            // Numbers past MAX_GROUP are invalid anyway; capping them avoids overflowing.
+            int group = escaped - '0';
+            while (not at_end() and peek() >= '0' and peek() <= '9') {
+                group = std::min(group * 10 + (pattern[offset++] - '0'), MAX_GROUP);
+            }
+
+            backrefs.emplace_back(group, start);
+            return make<Backref>(group);
+        }
+
+    public:
+        explicit Parser(const std::string_view pattern) : pattern(pattern) {}
+
+        std::shared_ptr<Token> parse() {
+            auto branches = parse_branches();
+            if (not at_end()) {
+                throw PatternError("unmatched ')'", pattern, offset);
+            }
+
+            for (const auto &[group, reference_offset]: backrefs) {
+                if (group == 0 or group > group_count) {
+                    throw PatternError("invalid back reference", pattern, reference_offset);
+                }
+            }
+
+            // An alternation at the top level captures nothing: the root already spans the whole match.
+            std::shared_ptr<Level> root;
+            if (branches.size() == 1) {
+                root = std::static_pointer_cast<Level>(branches.front());
+            } else {
+                root = make<Level>();
+                auto alternation = make<Alternation>(false);
+                alternation->children = std::move(branches);
+                root->children.push_back(std::move(alternation));
+            }
+
+            // The whole pattern is group 0, so \1 refers to the first parenthesized group.
+            TokenNumbering numbering;
+            root->number(numbering);
+
+            return root;
+        }
+    };
+}
+
+
+std::shared_ptr<Token> tokenize(const std::string& input) {
+    return Parser(input).parse();
 }
@@ -1,44 +1,69 @@
 #include "tokens.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <optional>
 
+#include "literals.hpp"
+#include "program.hpp"
+#include "stats.hpp"
+#include "trigrams.hpp"
 
-matched_results Level::match_here(const MatchContext& context, const size_t tokens_pos) const {
-    matched_results matches;
 
-    if (tokens_pos == children.size()) {
-        matches.emplace_back(context.backreference, context.position);
-        return matches;
-    }
+void Token::collect_literals(RequiredLiterals &literals) const {
+    literals.break_run();
+}
 
-    auto [add_backreference, matched_results] = children[tokens_pos]->get_matches(context);
+void Token::collect_trigrams(TrigramQueryBuilder &query) const {
+    query.break_run();
+}
 
-    if (matched_results.empty()) {
-        return matches;
+void Token::number(TokenNumbering &numbering) {
+    for (const auto& token: children) {
+        token->number(numbering);
     }
+}
 
-    for (const auto& matched_result: matched_results) {
-        Backreference new_backreference = matched_result.first;
-        MatchContext new_context = MatchContext(context.input, matched_result.second, new_backreference);
 
-        if (add_backreference) {
-            const size_t matched_len = matched_result.second - context.position;
-            new_backreference.add_match(context.input.substr(context.position, matched_len));
-        }
+bool Level::match_here(const MatchContext& context, const size_t tokens_pos, const MatchContinuation &next) const {
+    [[maybe_unused]] const DepthScope depth;
+    if (context.budget != nullptr) {
+        context.budget->step();
+    }
+
+    const int memo_slot = memo_base + static_cast<int>(tokens_pos);
+    if (context.memo != nullptr and context.memo->failed(memo_slot, context.position)) {
+        return false;
+    }
 
-        std::ranges::for_each(match_here(new_context, tokens_pos + 1), [&](auto match) {
-            matches.push_back(match);
+    bool matched;
+    if (tokens_pos == children.size()) {
+        matched = next(context.backreference, context.position);
+    } else {
+        matched = children[tokens_pos]->get_matches(context, [&](const Backreference &backreference, const size_t position) {
+            return match_here(MatchContext(context.input, position, backreference, context.memo, context.budget),
+                              tokens_pos + 1, next);
         });
     }
 
-    return matches;
+    if (not matched and context.memo != nullptr) {
+        context.memo->mark_failed(memo_slot, context.position);
+    }
+
+    return matched;
 }
 
-MatchResult Level::get_matches(const MatchContext &context) const {
-    context.backreference.init_index();
-    auto result = MatchResult(true, match_here(context, 0));
+bool Level::get_matches(const MatchContext &context, const MatchContinuation &next) const {
+    count_stat(StatCounter::LevelCalls);
+    if (group < 0) {
+        return match_here(context, 0, next);
+    }
 
-    return result;
+    return match_here(context, 0, [&](const Backreference &backreference, const size_t position) {
+        Backreference captured = backreference;
+        captured.add_match(group, context.position, position);
+        return next(captured, position);
+    });
 }
 
 std::string Level::to_string(int depth) const {
@@ -51,71 +76,168 @@ std::string Level::to_string(int depth) const {
     return str;
 }
 
+void Level::compile(ProgramBuilder &builder) const {
+    if (group < 0) {
+        compile_sequence(builder);
+        return;
+    }
+
+    builder.add_group(group);
+    builder.emit({Opcode::Save, 0, 2 * group});
+    compile_sequence(builder);
+    builder.emit({Opcode::Save, 0, 2 * group + 1});
+}
+
+void Level::compile_sequence(ProgramBuilder &builder) const {
+    for (const auto& token: children) {
+        token->compile(builder);
+    }
+}
+
+void Level::collect_literals(RequiredLiterals &literals) const {
+    for (const auto& token: children) {
+        token->collect_literals(literals);
+    }
+}
+
+void Level::collect_trigrams(TrigramQueryBuilder &query) const {
+    for (const auto& token: children) {
+        token->collect_trigrams(query);
+    }
+}
+
+void Level::number(TokenNumbering &numbering) {
+    group = numbering.next_group++;
+    number_sequence(numbering);
+}
+
+// Bytes repeated by a repetition of a single-byte token, otherwise null
+static const ByteClass *repeated_byte_class(const Token &token) {
+    if (dynamic_cast<const OneOrMore *>(&token) != nullptr or dynamic_cast<const ZeroOrOne *>(&token) != nullptr
+        or dynamic_cast<const Repeat *>(&token) != nullptr) {
+        return token.children.back()->byte_class();
+    }
+    return nullptr;
+}
+
+// Whether a match of the token can neither start with one of the bytes nor be empty before the end of input
+static bool starts_outside(const Token &token, const ByteClass &bytes) {
+    if (dynamic_cast<const EndAnchor *>(&token) != nullptr) {
+        return true;
+    }
+    if (dynamic_cast<const Atomic *>(&token) != nullptr) {
+        return starts_outside(*token.children.back(), bytes);
+    }
+
+    const ByteClass *first = token.byte_class();
+    const auto *repeat = dynamic_cast<const Repeat *>(&token);
+    if (dynamic_cast<const OneOrMore *>(&token) != nullptr or (repeat != nullptr and repeat->min > 0)) {
+        first = token.children.back()->byte_class();
+    }
+    return first != nullptr and not first->intersects(bytes);
+}
+
+void Level::number_sequence(TokenNumbering &numbering) {
+    // Groups are numbered before the children and memo slots after them, so the root ends last.
+    Token::number(numbering);
+    memo_base = numbering.next_memo_slot;
+    numbering.next_memo_slot += static_cast<int>(children.size()) + 1;
+
+    // A repeated byte followed by a token that can't start with it can't give any back and let the
+    // rest match: the bytes after a shorter run are again repeated ones. Dropping those alternatives
+    // changes nothing but the time spent backtracking into the run, as in \d+: or \w+$.
+    for (size_t child = 0; child + 1 < children.size(); child++) {
+        const ByteClass *bytes = repeated_byte_class(*children[child]);
+        if (bytes != nullptr and starts_outside(*children[child + 1], *bytes)) {
+            auto atomic = std::make_shared<Atomic>(children[child]->index, true);
+            atomic->children.push_back(std::move(children[child]));
+            children[child] = std::move(atomic);
+        }
+    }
+}
+
 
-MatchResult Backref::get_matches(const MatchContext &context) const {
-    auto result = MatchResult();
+bool Backref::get_matches(const MatchContext &context, const MatchContinuation &next) const {
+    count_stat(StatCounter::BackrefCalls);
+    const auto [begin, end] = context.backreference.get_matched_at(backref_index);
+    const std::string_view to_match = context.input.substr(begin, end - begin);
 
-    std::string to_match = context.backreference.get_matched_at(backref_index);
-    if (context.input.substr(context.position, to_match.size()) == to_match) {
-        result.add_matched_result({context.backreference, context.position + to_match.size()});
+    if (context.position <= context.input.size() and context.input.substr(context.position).starts_with(to_match)) {
+        return next(context.backreference, context.position + to_match.size());
     }
 
-    return result;
+    return false;
 }
 
 std::string Backref::to_string(int depth) const {
-    return std::string(depth, '\t') + "Backref: " + std::to_string(backref_index - 1) + "\n";
+    return std::string(depth, '\t') + "Backref: " + std::to_string(backref_index) + "\n";
+}
+
+void Backref::compile(ProgramBuilder &builder) const {
+    builder.emit({Opcode::Backref, 0, backref_index});
+    builder.mark_backrefs();
 }
 
 
-MatchResult Literal::get_matches(const MatchContext &context) const {
-    auto result = MatchResult();
+Literal::Literal(const int index, const char _literal) : Token(index), literal(_literal) {
+    bytes.insert(static_cast<unsigned char>(literal));
+}
 
+bool Literal::get_matches(const MatchContext &context, const MatchContinuation &next) const {
+    count_stat(StatCounter::LiteralCalls);
     if (context.position >= context.input.size() or context.input.at(context.position) != literal) {
-        return result;
+        return false;
     }
 
-    result.add_matched_result({context.backreference, context.position + 1});
-    return result;
+    return next(context.backreference, context.position + 1);
 }
 
 std::string Literal::to_string(int depth) const {
     return std::string(depth, '\t') + "Literal: '" + std::string(1, literal) + "'\n";
 }
 
+void Literal::compile(ProgramBuilder &builder) const {
+    builder.emit({Opcode::Char, literal});
+}
 
-MatchResult Digit::get_matches(const MatchContext &context) const {
-    auto result = MatchResult();
+void Literal::collect_literals(RequiredLiterals &literals) const {
+    literals.append(literal);
+}
+
+void Literal::collect_trigrams(TrigramQueryBuilder &query) const {
+    query.append(literal);
+}
 
-    auto is_digit = [&](const char c) {
-        return std::ranges::any_of(constants::DIGITS, [&](const char digit) -> bool {
-            return c == digit;
-        });
-    };
 
-    if (context.position >= context.input.size() or not is_digit(context.input.at(context.position))) {
-        return result;
+bool ByteClassToken::get_matches(const MatchContext &context, const MatchContinuation &next) const {
+    count_stat(StatCounter::ByteClassCalls);
+    if (context.position >= context.input.size()
+        or not bytes.contains(static_cast<unsigned char>(context.input[context.position]))) {
+        return false;
     }
 
-    result.add_matched_result({context.backreference, context.position + 1});
-    return result;
+    return next(context.backreference, context.position + 1);
 }
 
-std::string Digit::to_string(int depth) const {
-    return std::string(depth, '\t') + "Digit\n";
+void ByteClassToken::compile(ProgramBuilder &builder) const {
+    builder.emit_byte_set(bytes);
 }
 
 
-MatchResult Alnum::get_matches(const MatchContext& context) const {
-    auto result = MatchResult();
+Digit::Digit(const int index) : ByteClassToken(index) {
+    bytes.insert_range('0', '9');
+}
+
+std::string Digit::to_string(int depth) const {
+    return std::string(depth, '\t') + "Digit\n";
+}
 
-    if (context.position >= context.input.size() or not isalnum(context.input.at(context.position)
-    )) {
-        return result;
-    }
 
-    result.add_matched_result({context.backreference, context.position + 1});
-    return result;
+Alnum::Alnum(const int index) : ByteClassToken(index) {
+    // ASCII only, whatever the locale
+    bytes.insert_range('0', '9');
+    bytes.insert_range('A', 'Z');
+    bytes.insert_range('a', 'z');
 }
 
 std::string Alnum::to_string(int depth) const {
@@ -123,20 +245,21 @@ std::string Alnum::to_string(int depth) const {
 }
 
 
-MatchResult PositiveCharacterGroup::get_matches(const MatchContext& context) const {
-    auto result = MatchResult();
-
-    auto matches_position = [&](const std::shared_ptr<Token> &token) {
-        return token->get_matches(context).has_matched();
-    };
-
-    if (std::ranges::any_of(children, matches_position)) {
-        result.add_matched_result({context.backreference, context.position + 1});
+// Adds the bytes each member of a character group matches on its own
+static void insert_members(ByteClass &bytes, const std::vector<std::shared_ptr<Token>> &members) {
+    CaptureArena arena; // members hold no groups
+    for (const auto &member: members) {
+        for (int byte = 0; byte < 256; byte++) {
+            const Backreference backreference(arena);
+            const std::string input(1, static_cast<char>(byte));
+            if (member->matches_at(MatchContext(input, 0, backreference))) {
+                bytes.insert(static_cast<unsigned char>(byte));
+            }
+        }
     }
-
-    return result;
 }
 
+
 std::string PositiveCharacterGroup::to_string(int depth) const {
     std::string str = std::string(depth, '\t') + "PositiveCharacterGroup:\n";
     for (const auto& token : children) {
@@ -145,19 +268,11 @@ std::string PositiveCharacterGroup::to_string(int depth) const {
     return str;
 }
 
+void PositiveCharacterGroup::number(TokenNumbering &numbering) {
+    Token::number(numbering);
 
-MatchResult NegativeCharacterGroup::get_matches(const MatchContext& context) const {
-    auto result = MatchResult();
-
-    auto matches_position = [&](const std::shared_ptr<Token> &token) {
-        return token->get_matches(context).has_matched();
-    };
-
-    if (std::ranges::none_of(children, matches_position)) {
-        result.add_matched_result({context.backreference, context.position + 1});
-    }
-
-    return result;
+    bytes = ByteClass();
+    insert_members(bytes, children);
 }
 
 
@@ -169,102 +284,310 @@ std::string NegativeCharacterGroup::to_string(int depth) const {
     return str;
 }
 
+void NegativeCharacterGroup::number(TokenNumbering &numbering) {
+    Token::number(numbering);
 
-MatchResult BeginAnchor::get_matches(const MatchContext& context) const {
-    auto result = MatchResult();
+    bytes = ByteClass();
+    insert_members(bytes, children);
+    bytes.invert();
+}
 
-    if (context.position == 0) {
-        result.add_matched_result({context.backreference, context.position});
-    }
 
-    return result;
+bool BeginAnchor::get_matches(const MatchContext& context, const MatchContinuation &next) const {
+    count_stat(StatCounter::AnchorCalls);
+    return context.position == 0 and next(context.backreference, context.position);
 }
 
 std::string BeginAnchor::to_string(int depth) const {
     return std::string(depth, '\t') + "BeginAnchor\n";
 }
 
+void BeginAnchor::compile(ProgramBuilder &builder) const {
+    builder.emit({Opcode::AssertBegin});
+}
 
-MatchResult EndAnchor::get_matches(const MatchContext& context) const {
-    auto result = MatchResult();
+void BeginAnchor::collect_literals(RequiredLiterals &literals) const {
+    literals.mark_inexact();
+}
+
+void BeginAnchor::collect_trigrams(TrigramQueryBuilder &) const {
+    // Consumes nothing: the runs around it continue.
+}
 
-    if (context.position == context.input.size()) {
-        result.add_matched_result({context.backreference, context.position});
-    }
 
-    return result;
+bool EndAnchor::get_matches(const MatchContext& context, const MatchContinuation &next) const {
+    count_stat(StatCounter::AnchorCalls);
+    return context.position == context.input.size() and next(context.backreference, context.position);
 }
 
 std::string EndAnchor::to_string(int depth) const {
     return std::string(depth, '\t') + "EndAnchor\n";
 }
 
+void EndAnchor::compile(ProgramBuilder &builder) const {
+    builder.emit({Opcode::AssertEnd});
+}
 
-MatchResult OneOrMore::get_matches(const MatchContext& context) const {
-    auto result = MatchResult();
+void EndAnchor::collect_literals(RequiredLiterals &literals) const {
+    literals.mark_inexact();
+}
 
-    auto matches_position = [&](const std::shared_ptr<Token> &token) -> bool {
-        return token->get_matches(context).has_matched();
-    };
+void EndAnchor::collect_trigrams(TrigramQueryBuilder &) const {
+    // Consumes nothing: the runs around it continue.
+}
+
+
+// Greedy repetitions of child from the count-th on, starting at the context position, up to max (-1 for
+// no limit). Past min, an iteration matching the empty string ends an unbounded repetition instead of
+// looping forever, as the Loop instruction does.
+static bool match_repetitions(const Token &child, const MatchContext &context, const int count, const int min,
+                              const int max, const MatchContinuation &next) {
+    // What follows an iteration depends on the count, so the memo is left out like in matches_at().
+    const bool repeated = (max < 0 or count < max) and child.get_matches(
+            MatchContext(context.input, context.position, context.backreference, nullptr, context.budget),
+            [&](const Backreference &backreference, const size_t position) {
+                if (max < 0 and count + 1 >= min and position == context.position) {
+                    return next(backreference, position);
+                }
+                return match_repetitions(child, MatchContext(context.input, position, backreference, nullptr, context.budget),
+                                         count + 1, min, max, next);
+            });
+
+    return repeated or (count >= min and next(context.backreference, context.position));
+}
+
+// Matches child between min and max times (-1 for no limit), the most repetitions first
+static bool match_repeated(const Token &child, const MatchContext &context, const int min, const int max,
+                           const MatchContinuation &next) {
+    const ByteClass *bytes = child.byte_class();
+    if (bytes == nullptr) {
+        return match_repetitions(child, context, 0, min, max, next);
+    }
 
-    size_t position = context.position;
-    while (position < context.input.size() and matches_position(children.back())) {
-        result.add_matched_result({context.backreference, ++position});
+    // A single-byte child: take the longest run at once, then give back one byte at a time.
+    size_t end = bytes->span(context.input, context.position, true);
+    if (max >= 0) {
+        end = std::min(end, context.position + max);
     }
 
-    return result;
+    const size_t shortest = context.position + min;
+    if (end < shortest) {
+        return false;
+    }
+    for (size_t position = end;; position--) {
+        if (next(context.backreference, position)) {
+            return true;
+        }
+        if (position == shortest) {
+            return false;
+        }
+    }
+}
+
+// Emits one or more greedy repetitions of child. A single-byte child always consumes input and loops
+// with a plain Split, which the backtracker runs as a byte loop; any other child may match the empty
+// string, which its Loop doesn't repeat.
+static void compile_one_or_more(ProgramBuilder &builder, const Token &child) {
+    const int begin = builder.pc();
+
+    if (child.byte_class() != nullptr) {
+        child.compile(builder);
+        builder.emit({Opcode::Split, 0, begin, builder.pc() + 1});
+        return;
+    }
+
+    const int mark = builder.emit_loop_mark();
+    child.compile(builder);
+    builder.emit_loop(begin, mark);
+}
+
+
+bool OneOrMore::get_matches(const MatchContext& context, const MatchContinuation &next) const {
+    count_stat(StatCounter::OneOrMoreCalls);
+    return match_repeated(*children.back(), context, 1, -1, next);
 }
 
 std::string OneOrMore::to_string(int depth) const {
     return std::string(depth, '\t') + "OneOrMore:\n" + children.back()->to_string(depth + 1);
 }
 
+void OneOrMore::compile(ProgramBuilder &builder) const {
+    compile_one_or_more(builder, *children.back());
+}
 
-MatchResult ZeroOrOne::get_matches(const MatchContext& context) const {
-    auto result = MatchResult();
+void OneOrMore::collect_literals(RequiredLiterals &literals) const {
+    // The first repetition continues the preceding run and the last one starts the next.
+    children.back()->collect_literals(literals);
+    literals.break_run();
+    children.back()->collect_literals(literals);
+}
 
-    result.add_matched_result({context.backreference, context.position});
+void OneOrMore::collect_trigrams(TrigramQueryBuilder &query) const {
+    // Like collect_literals: the first repetition ends the preceding run and the last starts the next.
+    children.back()->collect_trigrams(query);
+    query.break_run();
+    children.back()->collect_trigrams(query);
+}
 
-    if (children.back()->get_matches(context).has_matched()) {
-        result.add_matched_result({context.backreference, context.position + 1});
-    }
 
-    return result;
+bool ZeroOrOne::get_matches(const MatchContext& context, const MatchContinuation &next) const {
+    count_stat(StatCounter::ZeroOrOneCalls);
+    return match_repeated(*children.back(), context, 0, 1, next);
 }
 
 std::string ZeroOrOne::to_string(int depth) const {
     return std::string(depth, '\t') + "ZeroOrOne:\n" + children.back()->to_string(depth + 1);
 }
 
+void ZeroOrOne::compile(ProgramBuilder &builder) const {
+    const int split = builder.emit({Opcode::Split});
+
+    children.back()->compile(builder);
+    builder.at(split).argument = split + 1;
+    builder.at(split).alternative = builder.pc();
+}
+
+
+bool Repeat::get_matches(const MatchContext& context, const MatchContinuation &next) const {
+    count_stat(StatCounter::RepeatCalls);
+    return match_repeated(*children.back(), context, min, max, next);
+}
+
+std::string Repeat::to_string(int depth) const {
+    return std::string(depth, '\t') + "Repeat {" + std::to_string(min) + "," + (max < 0 ? "" : std::to_string(max))
+           + "}:\n" + children.back()->to_string(depth + 1);
+}
+
+void Repeat::compile(ProgramBuilder &builder) const {
+    const Token &child = *children.back();
 
-MatchResult Wildcard::get_matches(const MatchContext& context) const {
-    auto result = MatchResult();
+    // Without a maximum the last required repetition begins the loop.
+    if (max < 0) {
+        for (int count = 1; count < min; count++) {
+            child.compile(builder);
+        }
+        const int split = min == 0 ? builder.emit({Opcode::Split}) : -1;
+        compile_one_or_more(builder, child);
+        if (split >= 0) {
+            builder.at(split).argument = split + 1;
+            builder.at(split).alternative = builder.pc();
+        }
+        return;
+    }
 
-    if (context.position < context.input.size()) {
-        result.add_matched_result({context.backreference, context.position + 1});
+    for (int count = 0; count < min; count++) {
+        child.compile(builder);
     }
 
-    return result;
+    // Each optional repetition is entered through a split preferring it over skipping the rest.
+    std::vector<int> splits;
+    for (int count = min; count < max; count++) {
+        splits.push_back(builder.emit({Opcode::Split}));
+        builder.at(splits.back()).argument = splits.back() + 1;
+        child.compile(builder);
+    }
+    for (const int split: splits) {
+        builder.at(split).alternative = builder.pc();
+    }
 }
 
-std::string Wildcard::to_string(int depth) const {
-    return std::string(depth, '\t') + "Wildcard\n";
+void Repeat::collect_literals(RequiredLiterals &literals) const {
+    // Like OneOrMore when the child is required, otherwise the repetition may match nothing.
+    if (min == 0) {
+        Token::collect_literals(literals);
+        return;
+    }
+    children.back()->collect_literals(literals);
+    literals.break_run();
+    children.back()->collect_literals(literals);
+}
+
+void Repeat::collect_trigrams(TrigramQueryBuilder &query) const {
+    if (min == 0) {
+        Token::collect_trigrams(query);
+        return;
+    }
+    children.back()->collect_trigrams(query);
+    query.break_run();
+    children.back()->collect_trigrams(query);
 }
 
 
-MatchResult Alternation::get_matches(const MatchContext& context) const {
-    auto result = MatchResult(true);
+bool Atomic::get_matches(const MatchContext& context, const MatchContinuation &next) const {
+    count_stat(StatCounter::AtomicCalls);
 
-    for (const auto& token: children) {
-        Backreference new_backreference = context.backreference;
-        MatchContext new_context = MatchContext(context.input, context.position, new_backreference);
+    // Only the first way the child matches is kept; its continuation isn't the pattern's, so no memo.
+    std::optional<Backreference> captured;
+    size_t end = 0;
+    children.back()->get_matches(MatchContext(context.input, context.position, context.backreference, nullptr, context.budget),
+                                 [&](const Backreference &backreference, const size_t position) {
+                                     captured.emplace(backreference);
+                                     end = position;
+                                     return true;
+                                 });
 
-        for (const auto& match: token->get_matches(new_context).results) {
-            result.add_matched_result(match);
-        }
+    return captured.has_value() and next(*captured, end);
+}
+
+std::string Atomic::to_string(int depth) const {
+    return std::string(depth, '\t') + (implied ? "Atomic (implied):\n" : "Atomic:\n")
+           + children.back()->to_string(depth + 1);
+}
+
+void Atomic::compile(ProgramBuilder &builder) const {
+    if (not implied) {
+        builder.mark_atomic();
+    }
+
+    builder.emit({Opcode::AtomicBegin, 0, implied ? 0 : 1});
+    children.back()->compile(builder);
+    builder.emit({Opcode::AtomicEnd});
+}
+
+void Atomic::collect_literals(RequiredLiterals &literals) const {
+    children.back()->collect_literals(literals);
+}
+
+void Atomic::collect_trigrams(TrigramQueryBuilder &query) const {
+    children.back()->collect_trigrams(query);
+}
+
+void Atomic::number(TokenNumbering &numbering) {
+    // The Level of an atomic group captures nothing.
+    if (const auto level = std::dynamic_pointer_cast<Level>(children.back())) {
+        level->number_sequence(numbering);
+    } else {
+        Token::number(numbering);
+    }
+}
+
+
+Wildcard::Wildcard(const int index) : ByteClassToken(index) {
+    bytes.insert_range(0, 255);
+}
+
+std::string Wildcard::to_string(int depth) const {
+    return std::string(depth, '\t') + "Wildcard\n";
+}
+
+
+bool Alternation::get_matches(const MatchContext& context, const MatchContinuation &next) const {
+    count_stat(StatCounter::AlternationCalls);
+    if (group < 0) {
+        return std::ranges::any_of(children, [&](const std::shared_ptr<Token> &token) {
+            return token->get_matches(context, next);
+        });
     }
 
-    return result;
+    auto capture = [&](const Backreference &backreference, const size_t position) {
+        Backreference captured = backreference;
+        captured.add_match(group, context.position, position);
+        return next(captured, position);
+    };
+
+    return std::ranges::any_of(children, [&](const std::shared_ptr<Token> &token) {
+        return token->get_matches(context, capture);
+    });
 }
 
 std::string Alternation::to_string(int depth) const {
@@ -274,3 +597,62 @@ std::string Alternation::to_string(int depth) const {
     }
     return str;
 }
+
+void Alternation::compile(ProgramBuilder &builder) const {
+    std::vector<int> jumps;
+
+    if (group >= 0) {
+        builder.add_group(group);
+        builder.emit({Opcode::Save, 0, 2 * group});
+    }
+
+    // Each branch but the last is entered through a split preferring it over the remaining ones.
+    for (size_t branch = 0; branch < children.size(); branch++) {
+        const bool is_last = branch + 1 == children.size();
+        const int split = is_last ? -1 : builder.emit({Opcode::Split});
+
+        children[branch]->compile(builder);
+
+        if (not is_last) {
+            jumps.push_back(builder.emit({Opcode::Jump}));
+            builder.at(split).argument = split + 1;
+            builder.at(split).alternative = builder.pc();
+        }
+    }
+
+    for (const int jump: jumps) {
+        builder.at(jump).argument = builder.pc();
+    }
+
+    if (group >= 0) {
+        builder.emit({Opcode::Save, 0, 2 * group + 1});
+    }
+}
+
+void Alternation::collect_trigrams(TrigramQueryBuilder &query) const {
+    // A match contains the trigrams of one of the branches, each collected on its own.
+    std::vector<TrigramQuery> branches;
+    for (const auto& token: children) {
+        TrigramQueryBuilder branch;
+        token->collect_trigrams(branch);
+        branches.push_back(branch.finish());
+    }
+
+    query.break_run();
+    query.require(TrigramQuery::any_of(std::move(branches)));
+}
+
+void Alternation::number(TokenNumbering &numbering) {
+    if (capturing) {
+        group = numbering.next_group++;
+    }
+
+    // The branches capture as the alternation itself; only the groups nested in them get numbers.
+    for (const auto& token: children) {
+        if (const auto level = std::dynamic_pointer_cast<Level>(token)) {
+            level->number_sequence(numbering);
+        } else {
+            token->number(numbering);
+        }
+    }
+}
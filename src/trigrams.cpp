@@ -0,0 +1,100 @@
+#include "trigrams.hpp"
+
+#include <algorithm>
+
+
+TrigramQuery TrigramQuery::of_literal(const std::string_view literal) {
+    TrigramQuery query;
+    std::vector<uint32_t> seen; // a trigram repeated in the literal is asked for once
+    for (size_t position = 0; position + 3 <= literal.size(); position++) {
+        TrigramQuery trigram;
+        trigram.kind = Kind::Trigram;
+        trigram.trigram = pack_trigram(literal[position], literal[position + 1], literal[position + 2]);
+        if (std::ranges::find(seen, trigram.trigram) == seen.end()) {
+            seen.push_back(trigram.trigram);
+            query = both(std::move(query), std::move(trigram));
+        }
+    }
+    return query;
+}
+
+TrigramQuery TrigramQuery::both(TrigramQuery left, TrigramQuery right) {
+    if (left.is_all()) {
+        return right;
+    }
+    if (right.is_all()) {
+        return left;
+    }
+
+    TrigramQuery query;
+    query.kind = Kind::And;
+    for (auto *side: {&left, &right}) {
+        if (side->kind == Kind::And) {
+            std::ranges::move(side->children, std::back_inserter(query.children));
+        } else {
+            query.children.push_back(std::move(*side));
+        }
+    }
+    return query;
+}
+
+TrigramQuery TrigramQuery::any_of(std::vector<TrigramQuery> queries) {
+    if (queries.empty() or std::ranges::any_of(queries, &TrigramQuery::is_all)) {
+        return {};
+    }
+    if (queries.size() == 1) {
+        return std::move(queries.front());
+    }
+
+    TrigramQuery query;
+    query.kind = Kind::Or;
+    for (auto &child: queries) {
+        if (child.kind == Kind::Or) {
+            std::ranges::move(child.children, std::back_inserter(query.children));
+        } else {
+            query.children.push_back(std::move(child));
+        }
+    }
+    return query;
+}
+
+std::string TrigramQuery::to_string() const {
+    switch (kind) {
+        case Kind::All:
+            return "all";
+        case Kind::Trigram:
+            return std::string{'"', static_cast<char>(trigram >> 16), static_cast<char>(trigram >> 8),
+                               static_cast<char>(trigram), '"'};
+        default: {
+            std::string str = "(";
+            for (size_t index = 0; index < children.size(); index++) {
+                str += (index == 0 ? "" : kind == Kind::And ? " and " : " or ") + children[index].to_string();
+            }
+            return str + ")";
+        }
+    }
+}
+
+
+void TrigramQueryBuilder::append(const char literal) {
+    // Lines never contain a newline, and neither does the index.
+    if (literal == '\n') {
+        break_run();
+        return;
+    }
+    run += literal;
+}
+
+void TrigramQueryBuilder::break_run() {
+    query = TrigramQuery::both(std::move(query), TrigramQuery::of_literal(run));
+    run.clear();
+}
+
+void TrigramQueryBuilder::require(TrigramQuery required) {
+    query = TrigramQuery::both(std::move(query), std::move(required));
+}
+
+TrigramQuery TrigramQueryBuilder::finish() {
+    break_run();
+    return std::move(query);
+}
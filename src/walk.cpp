@@ -0,0 +1,50 @@
+#include "walk.hpp"
+
+#include <cerrno>
+#include <dirent.h>
+#include <sys/stat.h>
+
+
+void walk_directory(ThreadPool &pool, const std::string &path, const WalkCallbacks &callbacks) {
+    DIR *directory = opendir(path.c_str());
+    if (directory == nullptr) {
+        callbacks.on_error(path);
+        return;
+    }
+
+    const std::string prefix = path.ends_with('/') ? path : path + '/';
+
+    errno = 0;
+    while (const dirent *entry = readdir(directory)) {
+        const std::string_view name = entry->d_name;
+        if (name == "." or name == "..") {
+            continue;
+        }
+
+        std::string child = prefix;
+        child += name;
+
+        // d_type saves a stat per entry, except on file systems that don't fill it in.
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat status{};
+            if (lstat(child.c_str(), &status) == 0) {
+                type = S_ISDIR(status.st_mode) ? DT_DIR : S_ISREG(status.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+        }
+
+        if (type == DT_DIR) {
+            pool.submit([&pool, &callbacks, child = std::move(child)] {
+                walk_directory(pool, child, callbacks);
+            });
+        } else if (type == DT_REG) {
+            callbacks.on_file(std::move(child));
+        }
+        errno = 0;
+    }
+
+    if (errno != 0) {
+        callbacks.on_error(path);
+    }
+    closedir(directory);
+}
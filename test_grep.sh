@@ -35,3 +35,480 @@ run_test "'howwdy heeey there' is made up of 'howwdy' and 'heeey'. howwdy heeey
 run_test "cat and fish, cat with fish, cat and fish" "((c.t|d.g) and (f..h|b..d)), \\2 with \\3, \\1" 0
 run_test "bat and fish, bat with fish, bat and fish" "((c.t|d.g) and (f..h|b..d)), \\2 with \\3, \\1" 1
 
+
+# Multi-line input and file operands
+run_test $'first line\nsecond 42 line\nthird line' "\\d\\d line" 0
+run_test $'first line\nsecond line\nthird line' "\\d" 1
+run_test $'first line\nsecond line\n' "^second" 0
+
+# Like run_test, reading the named file instead of stdin
+run_file_test() {
+    pattern="$1"
+    file="$2"
+    expected_exit_code="$3"
+
+    ./server -E "$pattern" "$file" > /dev/null 2>&1
+    actual_exit_code=$?
+
+    if [ $actual_exit_code -eq $expected_exit_code ]; then
+        echo "File test passed: '$pattern' on '$file'"
+    else
+        echo "File test failed: '$pattern' on '$file'. Expected $expected_exit_code but got $actual_exit_code."
+        exit 1
+    fi
+}
+
+operand_file=$(mktemp)
+printf 'first line\nsecond 42 line\nthird line\n' > "$operand_file"
+run_file_test "\d\d line" "$operand_file" 0
+run_file_test "^\d" "$operand_file" 1
+run_file_test "line" "$operand_file.missing" 2
+rm -f "$operand_file"
+
+# Repetition and engine selection
+run_test "axxb" "a+b" 1
+run_test "aaab" "^a+b$" 0
+run_test $'x\n\ny' "^$" 0
+run_test "$(printf 'a%.0s' {1..200})" "(a|a)+(a|a)+b" 1
+run_test "$(printf 'a%.0s' {1..200})b!" "(a|a)+(a|a)+(x)?\\3b$" 3
+run_test "abababc" "^(ab)+c$" 0
+run_test "abac" "^x*(ab)*c$" 1
+run_test "aaab" "^a{2,3}b$" 0
+run_test "aaaab" "^a{2,3}b$" 1
+run_test "aaab" "(?>a+)ab" 1
+run_test "aaab" "a++b" 0
+run_test "aaa" "a*+a" 1
+run_test "$(printf '1%.0s' {1..20000}):ab" "\\d+:(\\w)\\1" 1
+run_test "abaabb" "^(a\\1b)+$" 0
+run_test "11cc1a" "(?>.\\d(c*[ab]*+[^a]*\\1){1,2})\\1" 1
+
+# Pattern syntax
+run_test "dog dog" "((c)at|(d)og) \\1" 0
+run_test "a.c" "abc|a\\.c" 0
+run_test "abc" "a\\.c" 1
+run_test "abc" "a(bc" 2
+run_test "a{,2}" "^a{,2}$" 0
+run_test "aa" "a{3,2}" 2
+
+# Several patterns, comparing the output
+run_output_test() {
+    input="$1"
+    expected_output="$2"
+    expected_exit_code="$3"
+    shift 3
+
+    actual_output=$(echo -n "$input" | ./server "$@")
+    actual_exit_code=$?
+
+    if [ $actual_exit_code -eq $expected_exit_code ] && [ "$actual_output" == "$expected_output" ]; then
+        echo "Output test passed: '$*' with input '$input'"
+    else
+        echo "Output test failed: '$*' with input '$input'. Expected '$expected_output' ($expected_exit_code) but got '$actual_output' ($actual_exit_code)."
+        exit 1
+    fi
+}
+
+fruits=$'apple\nbanana\ncherry\ndate\nfig 42\n'
+run_output_test "$fruits" $'apple\ncherry\nfig 42' 0 -e "^a" -e "rr" -e "\d\d"
+run_output_test "$fruits" "" 1 -e "^b$" -e "x\d"
+run_output_test "$fruits" $'banana\ndate' 0 -e "nan" -e "ate"
+run_output_test "$fruits" $'banana\ndate\nfig 42' 0 -e "ban\w+" -e "^\w\w\w\w$" -e "g \d"
+run_output_test "$fruits" "" 2 -e "a" -e "a(b"
+if ./server -e "a" -e $'b\nc)d' < /dev/null 2>&1 | grep -qF "invalid pattern 'c)d': unmatched ')' at offset 1"; then
+    echo "Pattern error test passed"
+else
+    echo "Pattern error test failed"
+    exit 1
+fi
+run_output_test "$fruits" $'banana\ndate' 0 -e $'nan\nate'
+run_output_test "$fruits" $'apple\nbanana\ncherry\ndate\nfig 42' 0 -e $'nan\n'
+run_output_test "$fruits" $'apple\ncherry\ndate\nfig 42' 0 \
+    -e "^\w$" -e "^\w\w$" -e "^\w\w\w$" -e "^\w\w\w\w$" -e "^\w\w\w\w\w$" -e "^\w\w\w\w\w\w\w$" \
+    -e "^\w\w\w\w\w\w\w\w$" -e "^\w\w\w\w\w\w\w\w\w$" -e "^\w+ \d+$" -e "^c\w+y$"
+
+patterns_file=$(mktemp)
+printf 'ch\\w+\n^\\w\\w\\w \\d\nana\n' > "$patterns_file"
+run_output_test "$fruits" $'banana\ncherry\nfig 42' 0 -f "$patterns_file"
+run_output_test "$fruits" $'apple\nbanana\ncherry\nfig 42' 0 -f "$patterns_file" -e "pp"
+rm -f "$patterns_file"
+
+# Grouped repetition, which every engine must agree on
+repeated=$'ab\nabab c\naba\nxababy\nabcabcd\nbcbcd\nbd\n'
+for engine in tree backtrack pike dfa auto; do
+    run_output_test "$repeated" $'ab\nabab c\naba\nxababy\nabcabcd' 0 --engine=$engine -e "(ab)+"
+    run_output_test "$repeated" $'ab\nabab c' 0 --engine=$engine -e "^(ab)+( |$)"
+    run_output_test "$repeated" $'abab c\nxababy' 0 --engine=$engine -e "(ab){2}"
+    run_output_test "$repeated" $'abab\nabab\nabcabcd\nbcbcd' 0 --engine=$engine -o -e "(ab){2,}|(a|bc)+d"
+    run_output_test "$repeated" $'1:ab\n3:aba' 0 --engine=$engine -n -e "^(ab)*a?b?$"
+    run_output_test "$repeated" "" 1 --engine=$engine -e "^(ab)+ab$" -e "(ba)+b$"
+done
+
+# Output options, alone and combined, on stdin and on several files
+numbers=$'one 1\ntwo 22\nthree\nfour 4444 44\n'
+run_output_test "$numbers" $'1\n22\n4444\n44' 0 -o -e "\d+"
+run_output_test "$numbers" "3" 0 -c -e "\d+"
+run_output_test "$numbers" "0" 1 -c -e "x"
+run_output_test "$numbers" "(standard input)" 0 -l -e "\d+"
+run_output_test "$numbers" "" 1 -l -e "x"
+run_output_test "$numbers" $'1:one 1\n2:two 22\n4:four 4444 44' 0 -n -e "\d+"
+run_output_test "$numbers" "" 0 -q -e "\d+"
+run_output_test "$numbers" "" 1 -q -e "x"
+run_output_test "$numbers" "3" 0 -c -o -e "\d+"
+run_output_test "$numbers" $'1:1\n2:22\n4:4444\n4:44' 0 -n -o -e "\d+"
+run_output_test "$numbers" "" 0 -q -c -n -e "\d+"
+
+files_dir=$(mktemp -d)
+a="$files_dir/a.txt" b="$files_dir/b.txt" c="$files_dir/c.txt"
+printf '%s' "$numbers" > "$a"
+printf 'nothing\n' > "$b"
+printf '5 five\n' > "$c"
+run_output_test "" "$a"$'\n'"$c" 0 -l -e "\d" "$a" "$b" "$c"
+run_output_test "" "" 1 -l -e "x" "$a" "$b"
+run_output_test "" "$a:3"$'\n'"$b:0"$'\n'"$c:1" 0 -c -e "\d" "$a" "$b" "$c"
+run_output_test "" "$a:2:22"$'\n'"$a:4:4444"$'\n'"$a:4:44"$'\n'"$c:1:5" 0 -n -o -e "\d\d+|5" "$a" "$b" "$c"
+run_output_test "" "" 0 -q -e "five" "$a" "$c"
+rm -rf "$files_dir"
+
+# Compressed input, from files and stdin
+files_dir=$(mktemp -d)
+printf 'alpha 1\nbeta\n' | gzip > "$files_dir/a.gz"
+printf 'gamma 2\n' | gzip > "$files_dir/b.gz"
+cat "$files_dir/a.gz" "$files_dir/b.gz" > "$files_dir/ab.gz"
+head -c 20 "$files_dir/ab.gz" > "$files_dir/truncated.gz"
+cp "$files_dir/a.gz" "$files_dir/corrupt.gz"
+printf '\xff\xff\xff\xff\xff\xff' | dd of="$files_dir/corrupt.gz" bs=1 seek=12 conv=notrunc 2> /dev/null
+run_output_test "" "1:alpha 1" 0 -n -e "\d" "$files_dir/a.gz"
+run_output_test "" $'1:alpha 1\n3:gamma 2' 0 -n -e "\d" "$files_dir/ab.gz"
+run_output_test "" "1:alpha 1" 2 -n -e "\d" "$files_dir/truncated.gz"
+run_output_test "" "" 2 -e "\d" "$files_dir/corrupt.gz"
+if [ "$(./server -c -e "\w" < "$files_dir/ab.gz")" == "3" ]; then
+    echo "Compressed stdin test passed"
+else
+    echo "Compressed stdin test failed"
+    exit 1
+fi
+rm -rf "$files_dir"
+run_output_test $'\x1f\n(\n' $'\x1f\n(' 0 -e "."
+
+# A large, highly compressible zstd file, whose frames decode to far more than one buffer; skipped when
+# the zstd tool is missing or the binary was built without ZSTD=1
+files_dir=$(mktemp -d)
+if command -v zstd > /dev/null; then
+    { yes "zstd line of text" | head -n 400000; echo "last 42"; } > "$files_dir/big.txt"
+    zstd -q -19 "$files_dir/big.txt" -o "$files_dir/big.zst"
+    if ./server -q -e "x" "$files_dir/big.zst" 2>&1 | grep -q "not supported"; then
+        echo "Zstd test skipped: built without ZSTD=1"
+    else
+        run_output_test "" "400001" 0 -c -e "\w" "$files_dir/big.zst"
+        run_output_test "" "400001:last 42" 0 -n -e "\d" "$files_dir/big.zst"
+    fi
+else
+    echo "Zstd test skipped: no zstd tool"
+fi
+rm -rf "$files_dir"
+
+# A pipe holding one short line is answered without waiting for more input
+if timeout 3 ./server -q -e "\d" < <(printf 'x1\n'; sleep 5); then
+    echo "Short input test passed"
+else
+    echo "Short input test failed"
+    exit 1
+fi
+
+# Recursive search, from inside the tree so names are relative. Files are written whole in the order
+# they finish, so the output is compared sorted, and each file must come in one piece.
+run_recursive_test() {
+    expected_output="$1"
+    expected_exit_code="$2"
+    shift 2
+
+    actual_output=$(cd "$files_dir" && "$OLDPWD/server" "$@" 2> /dev/null)
+    actual_exit_code=$?
+    sorted_output=$(echo "$actual_output" | LC_ALL=C sort -t: -k1,1 -s)
+    pieces=$(echo "$actual_output" | cut -d: -f1 | uniq | sort | uniq -d)
+
+    if [ $actual_exit_code -eq $expected_exit_code ] && [ "$sorted_output" == "$expected_output" ] && [ -z "$pieces" ]; then
+        echo "Recursive test passed: '$*'"
+    else
+        echo "Recursive test failed: '$*'. Expected '$expected_output' ($expected_exit_code) but got '$actual_output' ($actual_exit_code)."
+        rm -rf "$files_dir"
+        exit 1
+    fi
+}
+
+files_dir=$(mktemp -d)
+mkdir -p "$files_dir/d/sub" "$files_dir/e"
+printf 'hit 1\nmiss\nhit 2\nhit 3\n' > "$files_dir/d/a.txt"
+printf 'hit 4\n' > "$files_dir/d/sub/b.txt"
+printf 'hit\0binary\n' > "$files_dir/d/bin.dat"
+printf 'hit 5\n' > "$files_dir/e/c.txt"
+ln -s ../e "$files_dir/d/link"
+for threads in 1 4; do
+    run_recursive_test $'d/a.txt:1:hit 1\nd/a.txt:3:hit 2\nd/a.txt:4:hit 3\nd/sub/b.txt:1:hit 4\ne/c.txt:1:hit 5' 0 \
+        -r -n -j $threads -e "hit" d e
+done
+run_recursive_test $'./d/a.txt:hit 1\n./d/a.txt:hit 2\n./d/a.txt:hit 3\n./d/sub/b.txt:hit 4\n./e/c.txt:hit 5' 0 -r -e "hit"
+run_recursive_test $'d/a.txt:hit 1\nd/a.txt:hit 2\nd/a.txt:hit 3' 0 -r -e "hit" d/a.txt
+run_recursive_test $'d/a.txt:3\nd/sub/b.txt:1' 0 -r -c -e "hit" d
+run_recursive_test $'d/a.txt\nd/sub/b.txt\ne/c.txt' 0 -r -l -e "hit" d e
+run_recursive_test "" 1 -r -e "binary" d
+run_recursive_test $'e/c.txt:hit 5' 2 -r -e "hit" missing e
+if [ "$(id -u)" != 0 ]; then
+    chmod 000 "$files_dir/d/sub"
+    run_recursive_test $'d/a.txt:hit 1\nd/a.txt:hit 2\nd/a.txt:hit 3' 2 -r -e "hit" d
+    chmod 755 "$files_dir/d/sub"
+fi
+rm -rf "$files_dir"
+
+# Large files are scanned in chunks on a thread pool; a tiny chunk size takes that path on small files,
+# which must print the same as a sequential scan, in order, including lines cut by a chunk boundary.
+run_chunk_test() {
+    expected_output=$(./server "$@")
+    actual_output=$(./server --chunk-size=64 -j 4 "$@")
+
+    if [ "$actual_output" == "$expected_output" ]; then
+        echo "Chunk test passed: '$*'"
+    else
+        echo "Chunk test failed: '$*'. Expected '$expected_output' but got '$actual_output'."
+        rm -rf "$files_dir"
+        exit 1
+    fi
+}
+
+files_dir=$(mktemp -d)
+for number in $(seq 1000); do
+    echo "line $number"
+done > "$files_dir/lines.txt"
+run_chunk_test -n -e "7\d$" "$files_dir/lines.txt"
+run_chunk_test -c -e "7\d$" "$files_dir/lines.txt"
+run_chunk_test -n -o -e "9+$" "$files_dir/lines.txt"
+run_chunk_test -l -e "500" "$files_dir/lines.txt" "$files_dir/lines.txt"
+
+{ printf '%060d\n' 0; printf 'xx match yy\n'; printf 'tail\n%.0s' {1..30}; } > "$files_dir/straddle.txt"
+run_output_test "" "2:xx match yy" 0 --chunk-size=64 -j 4 -n -e "x m\w+ y" "$files_dir/straddle.txt"
+run_output_test "" "1" 0 --chunk-size=64 -j 4 -c -e "x m\w+ y" "$files_dir/straddle.txt"
+rm -rf "$files_dir"
+
+# Runs the arguments with and without the given options, which must not change the output or exit code
+run_compare_test() {
+    options="$1"
+    shift
+
+    expected_output=$(./server "$@" 2>&1)
+    expected_exit_code=$?
+    actual_output=$(./server "$@" $options 2>&1)
+    actual_exit_code=$?
+
+    if [ $actual_exit_code -eq $expected_exit_code ] && [ "$actual_output" == "$expected_output" ]; then
+        echo "Compare test passed: '$options' on '$*'"
+    else
+        echo "Compare test failed: '$options' on '$*'. Expected '$expected_output' ($expected_exit_code) but got '$actual_output' ($actual_exit_code)."
+        rm -rf "$files_dir"
+        exit 1
+    fi
+}
+
+# Lazy DFA caches too small for the states of the patterns: 32K is flushed over and over, 8K thrashes and
+# hands lines to the Pike VM, and ten patterns are more than a thread keeps caches for, so they are evicted
+files_dir=$(mktemp -d)
+awk 'BEGIN { for (i = 1; i <= 2000; i++) { n = i * 7919 % 65536; s = ""
+                 for (k = 0; k < 16; k++) { s = s (n % 2 ? "b" : "a"); n = int(n / 2) }
+                 print s "c " i } }' > "$files_dir/ab.txt"
+for cache in 8K 32K; do
+    run_compare_test "--engine=dfa --dfa-cache=$cache" --engine=pike -n -e "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)c" "$files_dir/ab.txt"
+    run_compare_test "--engine=dfa --dfa-cache=$cache" --engine=pike -o -e "a(a|b)(a|b)(a|b)c \d*7$" "$files_dir/ab.txt"
+done
+patterns=()
+for digit in 0 1 2 3 4 5 6 7 8 9; do
+    patterns+=(-e "(a|b)*a(a|b)(a|b)(a|b)(a|b)c $digit*$digit\$")
+done
+run_compare_test "--engine=dfa --dfa-cache=16K" --engine=pike -n "${patterns[@]}" "$files_dir/ab.txt"
+run_compare_test "--engine=dfa --dfa-cache=16K --chunk-size=4K -j 4" --engine=pike "${patterns[@]}" "$files_dir/ab.txt"
+run_output_test "$(head -n 3 "$files_dir/ab.txt")" "abbbbabbbabbbbaac 2" 0 --engine=dfa --dfa-cache=2K -e "^ab\w*c"
+rm -rf "$files_dir"
+run_output_test "a" "" 1 --dfa-cache=2X -e "a"
+run_output_test "a" "" 1 --dfa-cache= -e "a"
+
+# The memo must not change what the backtracking engines find on patterns that reach the same
+# (position, state) pair along several paths, and the continuations must keep backreferences right
+files_dir=$(mktemp -d)
+printf '%s\n' "abcd" "abbcd" "ababab x" "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa" "word word" "the cat cat sat" "abab abab" \
+    "xyxyxyxyxy z" "a1b2c3d4 5" "bcdbcd" "aab" "hello hello hello" "ab ab abab" "abcdbcd abcc" > "$files_dir/paths.txt"
+for engine in backtrack tree; do
+    for pattern in "(a|ab)(c|bcd)(d*)" "(\w+\s*)+x$" "(a|b|ab)*c" "(a*)*b" "(x|y|xy)+ z" "\w+\d\w*\d \d"; do
+        run_compare_test "--no-memo" --engine=$engine -n -e "$pattern" "$files_dir/paths.txt"
+        run_compare_test "--no-memo" --engine=$engine -o -e "$pattern" "$files_dir/paths.txt"
+        run_compare_test "--engine=$engine" --engine=pike -o -e "$pattern" "$files_dir/paths.txt"
+    done
+    for pattern in "(\w+) \1" "(a|ab)(c|bcd)\2" "((a)|b)+\2" "(\w+) (\w+) \2" "^(ab)+ \1" "(\w)\1+"; do
+        run_compare_test "--no-memo" --engine=$engine -n -e "$pattern" "$files_dir/paths.txt"
+    done
+done
+for pattern in "(\w+) \1" "(a|ab)(c|bcd)\2" "((a)|b)+\2" "(\w+) (\w+) \2" "^(ab)+ \1" "(\w)\1+"; do
+    run_compare_test "--engine=tree" --engine=backtrack -n -e "$pattern" "$files_dir/paths.txt"
+done
+run_output_test "" $'5:word word\n6:the cat cat sat\n7:abab abab\n12:hello hello hello\n13:ab ab abab' 0 --engine=tree -n -e "(\w\w+) \1" "$files_dir/paths.txt"
+run_output_test "" $'bcdbcd\nabcdbcd\nabcc' 0 --engine=tree -o -e "(a|ab)(c|bcd)\2|(bcd)\3" "$files_dir/paths.txt"
+rm -rf "$files_dir"
+
+# Character classes over runs longer than the 16 and 32 byte SIMD blocks, with high bytes and
+# non-members at and around block boundaries
+files_dir=$(mktemp -d)
+for length in 15 16 17 31 32 33 47 64 65 100; do
+    digits=$(printf '7%.0s' $(seq $length))
+    word=$(printf 'w%.0s' $(seq $length))
+    printf '%s\n' "$digits" "x${digits}x" "$word" "${word}"$'\xe9'"${word}" "${word}-${digits}" "${word}_9"
+done > "$files_dir/classes.txt"
+for engine in auto backtrack tree dfa; do
+    for pattern in "\d+" "\w+" "^\w+$" "[^x-]+" "[w7]+" "\d{33}" "w+\d" "\W"; do
+        run_compare_test "--engine=$engine" --engine=pike -n -o -e "$pattern" "$files_dir/classes.txt"
+    done
+done
+run_output_test "" "10" 0 -c -e $'\xe9' "$files_dir/classes.txt"
+run_output_test "" "30" 0 -c -e "^\w+$" "$files_dir/classes.txt"
+rm -rf "$files_dir"
+
+# The prefilter only skips lines lacking a literal every match holds: literals inside alternations or
+# optional groups must not be required, and every required one must be checked, in any order
+files_dir=$(mktemp -d)
+printf '%s\n' "foobaz" "barbaz" "baz alone" "needle" "needlec" "abneedle 7" "xneedle" "alpha then beta" \
+    "beta then alpha" "alphabeta" "betaalpha" "lit" "literal 1" "other" "needle twice needle" "nothing" \
+    > "$files_dir/literals.txt"
+for engine in auto backtrack dfa; do
+    for pattern in "(foo|bar)baz" "x?(ab)?needle ?\d?" "lit(eral)?|other" "(a|b)*needle(c|d)?$" "alpha\w* \w+ beta" \
+        "(alpha|beta)\w*(alpha|beta)" "needle.*needle" "(literal \d)?alone"; do
+        run_compare_test "--no-prefilter" --engine=$engine -n -e "$pattern" "$files_dir/literals.txt"
+        run_compare_test "--no-prefilter" --engine=$engine -o -e "$pattern" "$files_dir/literals.txt"
+    done
+    run_compare_test "--no-prefilter" --engine=$engine -c -e "needle" -e "(foo)?baz" -e "alpha\w+" "$files_dir/literals.txt"
+done
+run_output_test "" "12" 0 -c -e "needle|a\w*a|baz" "$files_dir/literals.txt"
+rm -rf "$files_dir"
+
+# Lines over a tiny step or memory budget are matched again by the Pike VM when the pattern has neither
+# backreferences nor atomic groups, so the output doesn't change
+files_dir=$(mktemp -d)
+for number in $(seq 300); do
+    echo "$(printf 'ab%.0s' $(seq $((number % 13))))c $number"
+done > "$files_dir/budget.txt"
+for engine in backtrack tree; do
+    run_compare_test "--step-budget=20" --engine=$engine -n -e "(a|b)*a?b(a|b)?c \d*7$" "$files_dir/budget.txt"
+    run_compare_test "--match-memory=64" --engine=$engine -o -e "(ab)+c \d+" "$files_dir/budget.txt"
+done
+rm -rf "$files_dir"
+
+# A memo table larger than --match-memory is left out: without it this line takes exponential time, over
+# the step budget, and the atomic group keeps the Pike VM from answering instead
+long_line="$(printf 'x%.0s' {1..100000})$(printf 'a%.0s' {1..25})"
+run_output_test "$long_line" "" 1 --engine=backtrack --step-budget=1000000 -e "(a|a)+(a|a)+\d(?>x)"
+run_output_test "$long_line" "" 3 --engine=backtrack --step-budget=1000000 --match-memory=64K -e "(a|a)+(a|a)+\d(?>x)"
+for option in --step-budget=abc --step-budget=-1 --step-budget= --match-memory=1Q --match-memory=K; do
+    run_output_test "a" "" 1 $option -e "a"
+done
+
+# --stats reports on stderr in every build
+if printf 'a1\nb\n' | ./server --stats -e "\d" 2>&1 > /dev/null | grep -q '"lines_read": 2'; then
+    echo "Stats test passed"
+else
+    echo "Stats test failed"
+    exit 1
+fi
+
+# -q and -l stop at the first match, even on endless input
+for option in -q -l; do
+    if timeout 10 bash -c "yes | ./server $option -e y > /dev/null"; then
+        echo "Early stop test passed: '$option'"
+    else
+        echo "Early stop test failed: '$option' did not stop at the first match"
+        exit 1
+    fi
+done
+
+# Daemon mode, through the client
+run_daemon_test() {
+    input="$1"
+    pattern="$2"
+    expected_output="$3"
+    expected_exit_code="$4"
+
+    actual_output=$(echo -n "$input" | ./build/client "$socket" -E "$pattern")
+    actual_exit_code=$?
+
+    if [ $actual_exit_code -eq $expected_exit_code ] && [ "$actual_output" == "$expected_output" ]; then
+        echo "Daemon test passed: '$pattern' with input '$input'"
+    else
+        echo "Daemon test failed: '$pattern' with input '$input'. Expected '$expected_output' ($expected_exit_code) but got '$actual_output' ($actual_exit_code)."
+        kill $daemon
+        exit 1
+    fi
+}
+
+socket=$(mktemp -u /tmp/grep-test.XXXXXX.sock)
+./server --daemon="$socket" &
+daemon=$!
+for attempt in $(seq 50); do
+    [ -S "$socket" ] && break
+    sleep 0.1
+done
+
+run_daemon_test $'first line\nsecond 42 line' "\\d\\d line" "second 42 line" 0
+run_daemon_test $'first line\nsecond line' "\\d" "" 1
+run_daemon_test "abc" "a(bc" "" 2
+kill $daemon
+wait $daemon
+
+# Trigram index, before and after the files change
+run_index_test() {
+    pattern="$1"
+    expected_output="$2"
+    expected_exit_code="$3"
+
+    actual_output=$(./server --index="$index_dir/index" -n -E "$pattern")
+    actual_exit_code=$?
+
+    if [ $actual_exit_code -eq $expected_exit_code ] && [ "$actual_output" == "$expected_output" ]; then
+        echo "Index test passed: '$pattern'"
+    else
+        echo "Index test failed: '$pattern'. Expected '$expected_output' ($expected_exit_code) but got '$actual_output' ($actual_exit_code)."
+        rm -rf "$index_dir"
+        exit 1
+    fi
+}
+
+index_dir=$(mktemp -d)
+printf 'first line\nsecond 42 line\n' > "$index_dir/a.txt"
+./server --build-index="$index_dir/index" "$index_dir/a.txt"
+
+run_index_test "\\d\\d line" "2:second 42 line" 0
+run_index_test "third" "" 1
+printf 'third 7 line\n' >> "$index_dir/a.txt"
+run_index_test "third" "3:third 7 line" 0
+printf 'rewritten\n' > "$index_dir/a.txt"
+run_index_test "rewritten" "1:rewritten" 0
+rm -rf "$index_dir"
+
+# A file indexed while empty has no blocks, all of what it gets later is new
+index_dir=$(mktemp -d)
+: > "$index_dir/a.log"
+printf 'hello\n' > "$index_dir/b.log"
+./server --build-index="$index_dir/index" "$index_dir/a.log" "$index_dir/b.log"
+printf 'xyz\n' >> "$index_dir/a.log"
+run_index_test "hello" "$index_dir/b.log:1:hello" 0
+run_index_test "xyz" "$index_dir/a.log:1:xyz" 0
+rm -rf "$index_dir"
+
+# Compile-time patterns, against the runtime matcher on the same lines
+if ./build/static_check; then
+    echo "Static pattern test passed"
+else
+    echo "Static pattern test failed"
+    exit 1
+fi
+
+# Batch matching through the library, on every engine and from several threads
+if ./build/library_check; then
+    echo "Library test passed"
+else
+    echo "Library test failed"
+    exit 1
+fi
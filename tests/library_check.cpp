@@ -0,0 +1,138 @@
+// Checks the batch API of the library: the bitmap and count of match_lines() on one pattern and on a
+// set, across 64-line words, the error for a short bitmap, and concurrent calls on one pattern and one
+// set from several threads, whose DFA caches are flushed and evicted during the calls. Prints each
+// failure and exits with 1 if any.
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Matcher.hpp"
+
+
+static size_t failures = 0;
+
+static void expect(const bool condition, const std::string &what) {
+    if (not condition) {
+        std::cerr << "failed: " << what << std::endl;
+        failures++;
+    }
+}
+
+// Lines 3n hold "hit n", the others "miss n"
+static std::vector<std::string> make_lines(const size_t count) {
+    std::vector<std::string> lines;
+    for (size_t index = 0; index < count; index++) {
+        lines.push_back((index % 3 == 0 ? "hit " : "miss ") + std::to_string(index));
+    }
+    return lines;
+}
+
+// Runs match_lines on a bitmap filled with ones, so that bits it fails to clear show
+template <typename Pattern>
+static void check_bitmap(const Pattern &pattern, const std::vector<std::string> &texts, const std::string &name) {
+    const std::vector<std::string_view> lines(texts.begin(), texts.end());
+    std::vector<uint64_t> matches(bitmap_words(lines.size()), ~uint64_t{0});
+
+    const size_t count = pattern.match_lines(lines, matches);
+
+    size_t expected_count = 0;
+    for (size_t index = 0; index < lines.size(); index++) {
+        const bool expected = index % 3 == 0;
+        expected_count += expected;
+        const bool bit = (matches[index / 64] >> (index % 64)) & 1;
+        expect(bit == expected, name + ": bit of line " + std::to_string(index) + " of " + std::to_string(lines.size()));
+    }
+    expect(count == expected_count, name + ": count " + std::to_string(count) + " for " + std::to_string(lines.size()) + " lines");
+    if (lines.size() % 64 != 0) {
+        expect((matches.back() >> (lines.size() % 64)) == 0, name + ": bits past the last line");
+    }
+}
+
+template <typename Pattern>
+static void check_short_bitmap(const Pattern &pattern, const std::string &name) {
+    const std::vector<std::string> texts = make_lines(65);
+    const std::vector<std::string_view> lines(texts.begin(), texts.end());
+    std::vector<uint64_t> matches(1);
+    try {
+        (void) pattern.match_lines(lines, matches);
+        expect(false, name + ": no std::invalid_argument for a short bitmap");
+    } catch (const std::invalid_argument &) {
+    }
+}
+
+int main() {
+    for (const Engine engine: {Engine::Auto, Engine::DFA, Engine::PikeVM, Engine::Backtrack, Engine::Tree}) {
+        PatternConfig config;
+        config.engine = engine;
+        const std::string name = "engine " + std::to_string(static_cast<int>(engine));
+        const CompiledPattern pattern = Matcher::compile("^h(i|o)t \\d+$", config);
+        const PatternSet set = Matcher::compile_set({"^hit", "^zzz", "(q)\\1"}, config);
+
+        for (const size_t count: {size_t{0}, size_t{1}, size_t{63}, size_t{64}, size_t{65}, size_t{130}}) {
+            check_bitmap(pattern, make_lines(count), name);
+            check_bitmap(set, make_lines(count), name + " set");
+        }
+        check_short_bitmap(pattern, name);
+        check_short_bitmap(set, name + " set");
+    }
+
+    // Threads share one pattern and one set of 20 DFAs with tiny caches, so that the caches are flushed
+    // and evicted while a batch still uses them; the Pike VM gives the expected bitmaps.
+    PatternConfig config;
+    config.engine = Engine::DFA;
+    config.dfa_memory_limit = 4096;
+    PatternConfig pike;
+    pike.engine = Engine::PikeVM;
+
+    std::vector<std::string> set_patterns;
+    for (int digit = 0; digit < 20; digit++) {
+        set_patterns.push_back("^(a|b)*c\\w+ \\d*" + std::to_string(digit % 10) + std::to_string(digit / 10) + "$");
+    }
+    const CompiledPattern shared = Matcher::compile("(a|b)*c\\w+ \\d*9$", config);
+    const PatternSet shared_set = Matcher::compile_set(set_patterns, config);
+
+    std::vector<std::string> texts;
+    for (size_t index = 0; index < 300; index++) {
+        texts.push_back(std::string(index % 17, index % 2 == 0 ? 'a' : 'b') + "cx" + std::to_string(index) + " "
+                        + std::to_string(index * 7));
+    }
+    const std::vector<std::string_view> lines(texts.begin(), texts.end());
+
+    std::vector<uint64_t> expected(bitmap_words(lines.size()));
+    const size_t expected_count = Matcher::compile("(a|b)*c\\w+ \\d*9$", pike).match_lines(lines, expected);
+    std::vector<uint64_t> expected_set(bitmap_words(lines.size()));
+    const size_t expected_set_count = Matcher::compile_set(set_patterns, pike).match_lines(lines, expected_set);
+    expect(expected_count > 0 and expected_set_count > expected_count, "threads: lines matching the patterns");
+
+    std::vector<size_t> wrong(8, 0);
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < wrong.size(); thread++) {
+        threads.emplace_back([&, thread] {
+            std::vector<uint64_t> matches(bitmap_words(lines.size()));
+            for (int round = 0; round < 10; round++) {
+                if (shared.match_lines(lines, matches) != expected_count or matches != expected) {
+                    wrong[thread]++;
+                }
+                if (shared_set.match_lines(lines, matches) != expected_set_count or matches != expected_set) {
+                    wrong[thread]++;
+                }
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    for (size_t thread = 0; thread < wrong.size(); thread++) {
+        expect(wrong[thread] == 0, "thread " + std::to_string(thread) + ": " + std::to_string(wrong[thread]) + " wrong batches");
+    }
+
+    if (failures > 0) {
+        std::cerr << failures << " failures" << std::endl;
+        return 1;
+    }
+    std::cout << "match_lines agrees on every engine, set and thread" << std::endl;
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Checks that StaticPattern matches exactly like the runtime matcher: every pattern below is compiled
+// both ways and run on the same lines, comparing match() and find() from several start positions, on
+// the default engine, the backtracker and the tree walk. Prints each disagreement and exits with 1 if any.
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Matcher.hpp"
+#include "StaticPattern.hpp"
+
+
+static std::string show(const std::optional<Span> &span) {
+    return span ? "[" + std::to_string(span->first) + ", " + std::to_string(span->second) + ")" : "none";
+}
+
+template <static_pattern::PatternText Text>
+static size_t check(const std::vector<std::string> &lines) {
+    using Static = StaticPattern<Text>;
+    const std::string pattern(Text.view());
+    size_t failures = 0;
+
+    for (const Engine engine: {Engine::Auto, Engine::Backtrack, Engine::Tree}) {
+        PatternConfig config;
+        config.engine = engine;
+        const CompiledPattern runtime = Matcher::compile(pattern, config);
+        for (const auto &line: lines) {
+            if (Static::match(line) != runtime.match(line)) {
+                std::cerr << "match /" << pattern << "/ on '" << line << "': static " << Static::match(line)
+                          << ", runtime " << runtime.match(line) << std::endl;
+                failures++;
+            }
+            for (const size_t from: {size_t{0}, size_t{1}, line.size() / 2, line.size()}) {
+                if (from > line.size()) {
+                    continue;
+                }
+                const auto expected = runtime.find(line, from);
+                const auto actual = Static::find(line, from);
+                if (actual != expected) {
+                    std::cerr << "find /" << pattern << "/ on '" << line << "' from " << from << ": static "
+                              << show(actual) << ", runtime " << show(expected) << std::endl;
+                    failures++;
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+int main() {
+    std::vector<std::string> lines = {
+            "",
+            "cat and cat is the same as cat and cat",
+            "grep 101 is doing grep 101 times, and again grep 101 times",
+            "abc-def is abc-def, not efg, abc, or def",
+            "apple pie is made of apple and pie. love apple pie",
+            "'howwdy hey there' is made up of 'howwdy' and 'hey'. howwdy hey there",
+            "cat and fish, cat with fish, cat and fish",
+            "error 404 in handler, error 500 in main",
+            "aaaaaaaaaaaaaaaaaaaab",
+            "abababab abab",
+            "x+y=z? [ok] a\\b",
+            "dog dog",
+            "a.c abc",
+            "11cc1a",
+    };
+
+    // Short lines over a small alphabet, so that most patterns match some of them in several ways
+    std::mt19937 random(42);
+    const std::string alphabet = "abcd01 -.";
+    for (int line = 0; line < 3000; line++) {
+        std::string text;
+        for (size_t length = random() % 14; length > 0; length--) {
+            text += alphabet[random() % alphabet.size()];
+        }
+        lines.push_back(text);
+    }
+
+    const size_t failures =
+            check<"">(lines) +
+            check<"abc">(lines) +
+            check<"a">(lines) +
+            check<"^ab">(lines) +
+            check<"cd$">(lines) +
+            check<"^$">(lines) +
+            check<"^a?b+$">(lines) +
+            check<"\\d+">(lines) +
+            check<"\\w+ \\w+">(lines) +
+            check<"[abc]+d">(lines) +
+            check<"[^ab]+">(lines) +
+            check<"[\\d-]+.">(lines) +
+            check<"a.c|b\\.">(lines) +
+            check<"(a|ab)(c|bcd)">(lines) +
+            check<"(ab)+c?">(lines) +
+            check<"(a|b?)+d">(lines) +
+            check<"((a|)b)+">(lines) +
+            check<"(a+)+b">(lines) +
+            check<"(b?)?c">(lines) +
+            check<"x+y=z\\? \\[ok\\]">(lines) +
+            check<"(a|b)c\\1">(lines) +
+            check<"(\\w)\\1">(lines) +
+            check<"((a)|b)+\\2">(lines) +
+            check<"(a\\1)?b">(lines) +
+            check<"((c)at|(d)og) \\1">(lines) +
+            check<"(\\w+) and \\1">(lines) +
+            check<"((\\w\\w\\w\\w) (\\d\\d\\d)) is doing \\2 \\3 times, and again \\1 times">(lines) +
+            check<"(([abc]+)-([def]+)) is \\1, not ([^xyz]+), \\2, or \\3">(lines) +
+            check<"^((\\w+) (\\w+)) is made of \\2 and \\3. love \\1$">(lines) +
+            check<"'((how+dy) (he?y) there)' is made up of '\\2' and '\\3'. \\1">(lines) +
+            check<"((c.t|d.g) and (f..h|b..d)), \\2 with \\3, \\1">(lines) +
+            check<"error (\\d+) in \\w+">(lines) +
+            check<"a*b">(lines) +
+            check<"(ab)*c">(lines) +
+            check<"a{2,3}">(lines) +
+            check<"[ab]{2,}c">(lines) +
+            check<"(a|b){1,3}d">(lines) +
+            check<"a{0}b|c{1}">(lines) +
+            check<"x{|\\d{2">(lines) +
+            check<"\\d+-">(lines) +
+            check<"\\d*\\.\\w+$">(lines) +
+            check<"(a*)*b">(lines) +
+            check<"(a|)+c">(lines) +
+            check<"(?>a+)b">(lines) +
+            check<"(?>a|ab)c">(lines) +
+            check<"a++a|b*+c">(lines) +
+            check<"(ab)?+a">(lines) +
+            check<"(a|)+\\1">(lines) +
+            check<"(\\d)\\1+-">(lines) +
+            check<"((a)|b){2}\\2">(lines) +
+            check<"(?>(a)|b)+\\1">(lines) +
+            check<"(\\w{2,})\\.\\1">(lines) +
+            check<"(a\\1b)+">(lines) +
+            check<"(?>.\\d(c*[ab]*+[^a]*\\1){1,2})\\1">(lines) +
+            check<"(.\\1)+$">(lines);
+
+    if (failures > 0) {
+        std::cerr << failures << " disagreements" << std::endl;
+        return 1;
+    }
+    std::cout << "static patterns agree with the runtime matcher on " << lines.size() << " lines" << std::endl;
+    return 0;
+}
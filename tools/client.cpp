@@ -0,0 +1,138 @@
+// Client of the search daemon (server --daemon=SOCKET), sending one request and printing its response:
+//
+//     client SOCKET [-c] [-l] [-n] [-o] [-q] [--repeat=N] -E pattern [-E pattern...] [file]
+//
+// With a file operand the daemon opens the file; otherwise stdin is read and sent as the data. The exit
+// status is that of the response. --repeat=N sends the same request N times over the connection and
+// reports the mean round trip on stderr.
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+static bool send_all(const int fd, std::string_view data) {
+    while (not data.empty()) {
+        const ssize_t count = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (count < 0 and errno != EINTR) {
+            return false;
+        }
+        data.remove_prefix(std::max<ssize_t>(count, 0));
+    }
+    return true;
+}
+
+// Reads one response into status and body, keeping what follows it in buffered
+static bool receive_response(const int fd, std::string &buffered, int &status, std::string &body) {
+    char chunk[64 << 10];
+    size_t header_end;
+    size_t body_size = 0;
+
+    while (true) {
+        header_end = buffered.find('\n');
+        if (header_end != std::string::npos) {
+            const char *space = std::strchr(buffered.c_str(), ' ');
+            if (space == nullptr) {
+                return false;
+            }
+            status = std::atoi(buffered.c_str());
+            std::from_chars(space + 1, buffered.data() + header_end, body_size);
+            if (buffered.size() >= header_end + 1 + body_size) {
+                break;
+            }
+        }
+
+        const ssize_t count = recv(fd, chunk, sizeof(chunk), 0);
+        if (count <= 0) {
+            if (count < 0 and errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buffered.append(chunk, count);
+    }
+
+    body = buffered.substr(header_end + 1, body_size);
+    buffered.erase(0, header_end + 1 + body_size);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: client SOCKET [-c] [-l] [-n] [-o] [-q] [--repeat=N] -E pattern [file]" << std::endl;
+        return 2;
+    }
+
+    std::string patterns;
+    std::string flags;
+    std::string file;
+    size_t repeat = 1;
+    for (int index = 2; index < argc; index++) {
+        const std::string_view argument = argv[index];
+        if ((argument == "-E" or argument == "-e") and index + 1 < argc) {
+            patterns += (patterns.empty() ? "" : "\n") + std::string(argv[++index]);
+        } else if (argument.size() == 2 and argument[0] == '-' and std::strchr("clnoq", argument[1]) != nullptr) {
+            flags += argument[1];
+        } else if (argument.starts_with("--repeat=")) {
+            repeat = std::max(std::strtoul(argv[index] + std::strlen("--repeat="), nullptr, 10), 1ul);
+        } else if (not argument.starts_with("-") and file.empty()) {
+            file = argument;
+        } else {
+            std::cerr << "client: unexpected argument '" << argument << "'" << std::endl;
+            return 2;
+        }
+    }
+
+    // The daemon may run in another directory.
+    std::string payload;
+    if (not file.empty()) {
+        char resolved[PATH_MAX];
+        payload = (realpath(file.c_str(), resolved) != nullptr) ? resolved : file;
+    } else {
+        payload.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    }
+
+    std::string request = std::string(file.empty() ? "data" : "file") + ' ' + std::to_string(patterns.size()) +
+                          ' ' + std::to_string(payload.size()) + (flags.empty() ? "" : " " + flags) + '\n';
+    request += patterns;
+    request += payload;
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 or connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) < 0) {
+        std::cerr << "client: " << argv[1] << ": " << std::strerror(errno) << std::endl;
+        return 2;
+    }
+
+    std::string buffered;
+    int status = 2;
+    std::string body;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < repeat; round++) {
+        if (not send_all(fd, request) or not receive_response(fd, buffered, status, body)) {
+            std::cerr << "client: connection lost" << std::endl;
+            return 2;
+        }
+    }
+    const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    close(fd);
+
+    if (repeat > 1) {
+        std::cerr << repeat << " requests, " << elapsed.count() / static_cast<double>(repeat) << " us each" << std::endl;
+    }
+    (status == 2 ? std::cerr : std::cout) << body << std::flush;
+    return status;
+}